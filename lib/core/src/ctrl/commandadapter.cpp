@@ -28,22 +28,32 @@ void LogResponse(std::string_view cmdName, int64_t response)
 
 } // namespace
 
-cr::TaskHandle<int64_t> CommandAdapter::ForwardUiCommand(mem::pool_ptr<cmd::ICommand> && cmd)
+int64_t CommandAdapter::LoggedResponse::await_resume() const
+{
+   const int64_t response = m_response.await_resume();
+   LogResponse(m_name, response);
+   return response;
+}
+
+CommandAdapter::LoggedResponse CommandAdapter::ForwardUiCommand(
+   mem::pool_ptr<cmd::ICommand> && cmd, std::chrono::milliseconds timeout)
 {
    LogCommand(cmd);
    const std::string_view name = cmd->GetName();
-   const int64_t response = co_await m_manager.IssueUiCommand(std::move(cmd));
-   LogResponse(name, response);
-   co_return response;
+   return LoggedResponse(m_manager.IssueUiCommand(std::move(cmd), timeout), name);
 }
 
-cr::TaskHandle<int64_t> CommandAdapter::ForwardBtCommand(mem::pool_ptr<cmd::ICommand> && cmd)
+CommandAdapter::LoggedResponse CommandAdapter::ForwardBtCommand(
+   mem::pool_ptr<cmd::ICommand> && cmd, std::chrono::milliseconds timeout)
 {
    LogCommand(cmd);
    const std::string_view name = cmd->GetName();
-   const int64_t response = co_await m_manager.IssueBtCommand(std::move(cmd));
-   LogResponse(name, response);
-   co_return response;
+   return LoggedResponse(m_manager.IssueBtCommand(std::move(cmd), timeout), name);
+}
+
+void CommandAdapter::LogLatencyStats() const
+{
+   m_manager.LogLatencyStats();
 }
 
 void CommandAdapter::DetachedUiCommand(mem::pool_ptr<cmd::ICommand> && cmd)
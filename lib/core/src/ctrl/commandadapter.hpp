@@ -3,11 +3,11 @@
 
 #include "utils/task.hpp"
 #include "utils/poolptr.hpp"
+#include "sign/commandmanager.hpp"
 #include "sign/commandpool.hpp"
 
-namespace cmd {
-class Manager;
-}
+#include <chrono>
+#include <string_view>
 
 namespace core {
 
@@ -22,7 +22,7 @@ public:
    cr::TaskHandle<typename TCmd::Response> Command(TArgs &&... args)
    {
       auto pcmd = cmd::pool.MakeUnique<TCmd>(std::forward<TArgs>(args)...);
-      const int64_t response = co_await ForwardUiCommand(std::move(pcmd));
+      const int64_t response = co_await ForwardUiCommand(std::move(pcmd), cmd::Manager::NO_TIMEOUT);
       co_return static_cast<typename TCmd::Response>(response);
    }
 
@@ -30,7 +30,26 @@ public:
    cr::TaskHandle<typename TCmd::Response> Command(TArgs &&... args)
    {
       auto pcmd = cmd::pool.MakeUnique<TCmd>(std::forward<TArgs>(args)...);
-      const int64_t response = co_await ForwardBtCommand(std::move(pcmd));
+      const int64_t response = co_await ForwardBtCommand(std::move(pcmd), cmd::Manager::NO_TIMEOUT);
+      co_return static_cast<typename TCmd::Response>(response);
+   }
+
+   // resolves to TIMEOUT if no response arrives within the given time
+   template <cmd::UiCommand TCmd, typename... TArgs>
+   cr::TaskHandle<typename TCmd::Response> CommandWithTimeout(std::chrono::milliseconds timeout,
+                                                              TArgs &&... args)
+   {
+      auto pcmd = cmd::pool.MakeUnique<TCmd>(std::forward<TArgs>(args)...);
+      const int64_t response = co_await ForwardUiCommand(std::move(pcmd), timeout);
+      co_return static_cast<typename TCmd::Response>(response);
+   }
+
+   template <cmd::BtCommand TCmd, typename... TArgs>
+   cr::TaskHandle<typename TCmd::Response> CommandWithTimeout(std::chrono::milliseconds timeout,
+                                                              TArgs &&... args)
+   {
+      auto pcmd = cmd::pool.MakeUnique<TCmd>(std::forward<TArgs>(args)...);
+      const int64_t response = co_await ForwardBtCommand(std::move(pcmd), timeout);
       co_return static_cast<typename TCmd::Response>(response);
    }
 
@@ -48,9 +67,31 @@ public:
       DetachedBtCommand(std::move(pcmd));
    }
 
+   void LogLatencyStats() const;
+
 private:
-   cr::TaskHandle<int64_t> ForwardUiCommand(mem::pool_ptr<cmd::ICommand> && cmd);
-   cr::TaskHandle<int64_t> ForwardBtCommand(mem::pool_ptr<cmd::ICommand> && cmd);
+   // the manager's response awaiter plus logging, so forwarding costs no frame of its own
+   class LoggedResponse
+   {
+   public:
+      LoggedResponse(cmd::Manager::FutureResponse response, std::string_view name) noexcept
+         : m_response(response)
+         , m_name(name)
+      {}
+      bool await_ready() const noexcept { return m_response.await_ready(); }
+      void await_suspend(stdcr::coroutine_handle<> h) const { m_response.await_suspend(h); }
+      int64_t await_resume() const;
+      bool Withdraw() noexcept { return m_response.Withdraw(); }
+
+   private:
+      cmd::Manager::FutureResponse m_response;
+      std::string_view m_name;
+   };
+
+   LoggedResponse ForwardUiCommand(mem::pool_ptr<cmd::ICommand> && cmd,
+                                   std::chrono::milliseconds timeout);
+   LoggedResponse ForwardBtCommand(mem::pool_ptr<cmd::ICommand> && cmd,
+                                   std::chrono::milliseconds timeout);
    void DetachedUiCommand(mem::pool_ptr<cmd::ICommand> && cmd);
    void DetachedBtCommand(mem::pool_ptr<cmd::ICommand> && cmd);
 
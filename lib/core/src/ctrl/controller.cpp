@@ -44,7 +44,10 @@ private:
    {
       if (m_cmdManager)
          return;
-      m_cmdManager = std::make_unique<cmd::Manager>(std::move(uiInvoker), std::move(btInvoker));
+      m_cmdManager = std::make_unique<cmd::Manager>(std::move(uiInvoker),
+                                                    std::move(btInvoker),
+                                                    m_timer.get());
+      cmd::Manager::BatchScope batch(*m_cmdManager);
       fsm::Context::SwitchToState<fsm::StateIdle>(fsm::Context{m_generator.get(),
                                                                m_serializer.get(),
                                                                m_timer.get(),
@@ -73,6 +76,7 @@ private:
          return;
       }
 
+      cmd::Manager::BatchScope batch(*m_cmdManager);
       bool success = (*handler)(*m_state, args);
       if (!success) [[unlikely]] {
          Log::Error(TAG, "Could not parse event args");
@@ -84,6 +88,7 @@ private:
          Log::Error("Command", "{}: no cmd manager", __func__);
          return;
       }
+      cmd::Manager::BatchScope batch(*m_cmdManager);
       m_cmdManager->SubmitResponse(cmdId, response);
    }
 
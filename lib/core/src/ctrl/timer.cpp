@@ -2,34 +2,33 @@
 
 #include <algorithm>
 #include <cassert>
+#include <utility>
 
 using namespace std::chrono_literals;
 
 namespace core {
 
-struct Timer::FutureTimeout
+void Timer::FutureTimeout::await_suspend(stdcr::coroutine_handle<> h)
 {
-   FutureTimeout(Timer & timer, std::chrono::milliseconds timeout)
-      : m_timer(timer)
-      , m_timeout(timeout)
-   {}
-   bool await_ready() const noexcept { return false; }
-   void await_suspend(stdcr::coroutine_handle<> h) const
-   {
-      assert(m_timer.m_scheduler);
-      m_timer.m_scheduler(h, std::max(0ms, m_timeout));
-   }
-   Timeout await_resume() const noexcept { return {}; }
-
-private:
-   Timer & m_timer;
-   const std::chrono::milliseconds m_timeout;
-};
+   assert(m_timer.m_scheduler);
+   m_id = m_timer.m_scheduler(h, std::max(0ms, m_timeout));
+}
+
+bool Timer::FutureTimeout::Withdraw() noexcept
+{
+   return m_id != NO_TIMER && m_timer.m_canceller &&
+          m_timer.m_canceller(std::exchange(m_id, NO_TIMER));
+}
 
 
 cr::TaskHandle<Timeout> Timer::WaitFor(std::chrono::milliseconds delay)
 {
-   co_return co_await FutureTimeout(*this, delay);
+   co_return co_await After(delay);
+}
+
+Timer::FutureTimeout Timer::After(std::chrono::milliseconds delay) noexcept
+{
+   return FutureTimeout(*this, delay);
 }
 
 } // namespace core
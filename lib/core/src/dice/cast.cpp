@@ -2,6 +2,8 @@
 
 #include "utils/format.hpp"
 
+#include <algorithm>
+
 namespace dice {
 
 std::span<char> WriteAsText(const Cast & cast, std::span<char> dest)
@@ -13,4 +15,16 @@ std::span<char> WriteAsText(const Cast & cast, std::span<char> dest)
    return dest;
 }
 
+std::span<uint8_t> WriteAsBytes(const Cast & cast, std::span<uint8_t> dest)
+{
+   static_assert(D100::value_type::MAX <= UINT8_MAX);
+   cast.Apply([&](const auto & vec) {
+      const size_t count = std::min(vec.size(), dest.size());
+      for (size_t i = 0; i < count; ++i)
+         dest[i] = static_cast<uint8_t>(vec[i]);
+      dest = dest.subspan(count);
+   });
+   return dest;
+}
+
 } // namespace dice
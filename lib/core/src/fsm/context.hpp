@@ -4,6 +4,7 @@
 #include "ctrl/commandadapter.hpp"
 #include "ctrl/timer.hpp"
 #include "fsm/statebase.hpp"
+#include "sign/commandpool.hpp"
 
 #include "utils/task.hpp"
 
@@ -45,19 +46,21 @@ private:
 template <typename S, typename... Args>
 inline cr::DetachedHandle Context::SwitchToState(Context ctx, Args... args)
 {
-   co_await ctx.timer->WaitFor(std::chrono::milliseconds(0));
+   co_await ctx.timer->After(std::chrono::milliseconds(0));
 
    if (auto * state = ctx.stateHolder.get(); state && typeid(*state) == typeid(S))
       co_return;
 
    ctx.stateHolder.reset();
    ctx.stateHolder = std::make_unique<S>(ctx, std::move(args)...);
+   cmd::LogPoolStats();
+   ctx.proxy.LogLatencyStats();
 }
 
 template <>
 inline cr::DetachedHandle Context::SwitchToState<void>(Context ctx)
 {
-   co_await ctx.timer->WaitFor(std::chrono::milliseconds(0));
+   co_await ctx.timer->After(std::chrono::milliseconds(0));
    ctx.stateHolder.reset();
 }
 
@@ -22,6 +22,7 @@ constexpr uint32_t MAX_GAME_START_RETRY_COUNT = 30U;
 constexpr uint32_t MAX_DISCOVERY_RETRY_COUNT = 2U;
 constexpr uint32_t MAX_LISTENING_RETRY_COUNT = 2U;
 constexpr auto DISCOVERABILITY_DURATION = 5min;
+constexpr auto DISCONNECT_TIMEOUT = 15s;
 
 } // namespace
 
@@ -138,7 +139,8 @@ cr::TaskHandle<void> StateConnecting::DisconnectDevice(std::string mac)
    Response response;
 
    do {
-      response = co_await m_ctx.proxy.Command<cmd::CloseConnection>("", mac);
+      response =
+         co_await m_ctx.proxy.CommandWithTimeout<cmd::CloseConnection>(DISCONNECT_TIMEOUT, "", mac);
    } while (response == Response::INVALID_STATE);
 }
 
@@ -158,7 +160,7 @@ cr::TaskHandle<void> StateConnecting::AttemptNegotiationStart()
       if (retriesLeft % 3 == 0)
          m_ctx.proxy.FireAndForget<cmd::ShowToast>("Getting ready...", 3s);
 
-      co_await m_ctx.timer->WaitFor(1s);
+      co_await m_ctx.timer->After(1s);
 
    } while (--retriesLeft > 0);
 
@@ -187,7 +189,7 @@ cr::TaskHandle<void> StateConnecting::KickOffDiscovery()
          OnBluetoothOff();
          break;
       case Response::INVALID_STATE:
-         co_await m_ctx.timer->WaitFor(1s);
+         co_await m_ctx.timer->After(1s);
          break;
       default:
          m_discovering = false;
@@ -226,7 +228,7 @@ cr::TaskHandle<void> StateConnecting::KickOffListening()
          DetectFatalFailure();
          co_return;
       default:
-         co_await m_ctx.timer->WaitFor(1s);
+         co_await m_ctx.timer->After(1s);
          break;
       }
 
@@ -69,7 +69,8 @@ cr::TaskHandle<void> StateIdle::RequestBluetoothOn()
       switch (result) {
       case Response::INTEROP_FAILURE:
       case Response::INVALID_STATE:
-         co_await m_ctx.timer->WaitFor(1s);
+      case Response::TIMEOUT:
+         co_await m_ctx.timer->After(1s);
          break;
       case Response::OK:
          if (m_newGamePending)
@@ -6,15 +6,18 @@
 #include "sign/commands.hpp"
 
 #include "utils/log.hpp"
+#include "utils/taskutils.hpp"
 
 #include <algorithm>
 #include <iterator>
+#include <vector>
 
 namespace fsm {
 using namespace std::chrono_literals;
 
 namespace {
 constexpr auto TAG = "FSM";
+constexpr auto DISCONNECT_TIMEOUT = 15s;
 }
 
 uint32_t g_negotiationRound = 0U;
@@ -108,6 +111,7 @@ cr::TaskHandle<void> StateNegotiating::StartNegotiation()
       break;
    case Response::INTEROP_FAILURE:
    case Response::INVALID_STATE:
+   case Response::TIMEOUT:
       Log::Error(TAG, "{}: Cannot start negotiation in invalid state", __func__);
       break;
    }
@@ -150,12 +154,14 @@ cr::TaskHandle<void> StateNegotiating::UpdateAndBroadcastOffer()
       localOffer->second.round = g_negotiationRound;
       localOffer->second.mac = GetLocalOfferMac();
 
-      // broadcast local offer
+      // broadcast local offer to all peers at once
       std::string message = m_ctx.serializer->Serialize(localOffer->second);
-      for (const auto & remote : m_peers) {
-         co_await StartNestedTask(SendOffer(message, remote));
-      }
-      co_await m_ctx.timer->WaitFor(1s);
+      std::vector<cr::TaskHandle<void>> sends;
+      sends.reserve(m_peers.size());
+      for (const auto & remote : m_peers)
+         sends.push_back(SendOffer(message, remote));
+      co_await cr::WhenAll(std::move(sends));
+      co_await m_ctx.timer->After(1s);
    }
 }
 
@@ -163,7 +169,8 @@ cr::TaskHandle<void> StateNegotiating::SendOffer(std::string offer, bt::Device r
 {
    using Response = cmd::SendMessageResponse;
 
-   const Response response = co_await m_ctx.proxy.Command<cmd::SendMessage>(offer, receiver.mac);
+   const Response response =
+      co_await m_ctx.proxy.Command<cmd::SendMessage>(std::move(offer), receiver.mac);
 
    switch (response) {
    case Response::SOCKET_ERROR:
@@ -185,7 +192,8 @@ cr::TaskHandle<void> StateNegotiating::DisconnectDevice(std::string mac)
    Response response;
 
    do {
-      response = co_await m_ctx.proxy.Command<cmd::CloseConnection>("", mac);
+      response =
+         co_await m_ctx.proxy.CommandWithTimeout<cmd::CloseConnection>(DISCONNECT_TIMEOUT, "", mac);
    } while (response == Response::INVALID_STATE || response == Response::INTEROP_FAILURE);
 }
 
@@ -8,7 +8,11 @@
 
 #include "utils/log.hpp"
 
+#include <algorithm>
+#include <cstddef>
 #include <functional>
+#include <span>
+#include <utility>
 #include <vector>
 
 using namespace std::chrono_literals;
@@ -19,6 +23,8 @@ constexpr uint32_t RETRY_COUNT = 5U;
 constexpr uint32_t REQUEST_ATTEMPTS = 3U;
 constexpr uint32_t ROUNDS_PER_GENERATOR = 10U;
 constexpr auto IGNORE_OFFERS_DURATION = 10s;
+constexpr auto SEND_TIMEOUT = 30s;
+constexpr size_t MAX_SHOWN_AT_ONCE = cmd::ShowLongResponse::MAX_BUFFER_SIZE / 3;
 
 bool Matches(const dice::Response & response, const dice::Request * request)
 {
@@ -49,6 +55,37 @@ dice::Response GenerateResponse(dice::IEngine & engine, dice::Request && request
    return dice::Response{std::move(request.cast), successCount};
 }
 
+size_t GetSize(const dice::Cast & cast)
+{
+   return cast.Apply([](const auto & vec) {
+      return vec.size();
+   });
+}
+
+// rolls a cast in pieces of at most maxSize dice, each only when the consumer asks for it, so
+// that just one piece exists at a time; successCount is the total up to and including the piece
+cr::AsyncGenerator<dice::Response> GenerateInPieces(dice::IEngine & engine,
+                                                    std::string type,
+                                                    size_t size,
+                                                    std::optional<uint32_t> threshold,
+                                                    size_t maxSize)
+{
+   std::optional<size_t> successCount;
+   if (threshold)
+      successCount = 0U;
+   for (size_t done = 0; done < size;) {
+      const size_t count = std::min(maxSize, size - done);
+      dice::Cast piece = dice::MakeCast(type, count);
+      engine.GenerateResult(piece);
+      if (threshold)
+         *successCount += dice::GetSuccessCount(piece, *threshold);
+      done += count;
+      // named, g++ 12 destroys a braced temporary in co_yield twice
+      dice::Response response{std::move(piece), successCount};
+      co_yield std::move(response);
+   }
+}
+
 } // namespace
 
 namespace fsm {
@@ -91,15 +128,22 @@ bool StatePlaying::RemotePeerManager::IsGenerator() const
    return m_isGenerator;
 }
 
-void StatePlaying::RemotePeerManager::SendRequest(const std::string & request)
+void StatePlaying::RemotePeerManager::ExpectResponse()
 {
    m_pendingRequest = true;
-   StartRootTask(m_isGenerator ? SendRequestToGenerator(request) : Send(request));
 }
 
-void StatePlaying::RemotePeerManager::SendResponse(const std::string & response)
+void StatePlaying::RemotePeerManager::SendRequest(const std::string & request,
+                                                  cmd::SendMessageResponse multicastResult)
+{
+   StartRootTask(m_isGenerator ? SendRequestToGenerator(request, multicastResult)
+                               : Send(request, multicastResult));
+}
+
+void StatePlaying::RemotePeerManager::SendResponse(const std::string & response,
+                                                   cmd::SendMessageResponse multicastResult)
 {
-   StartRootTask(Send(response));
+   StartRootTask(Send(response, multicastResult));
 }
 
 void StatePlaying::RemotePeerManager::OnReceptionSuccess(bool answeredRequest)
@@ -116,20 +160,24 @@ void StatePlaying::RemotePeerManager::OnReceptionFailure()
       m_renegotiate();
 }
 
-cr::TaskHandle<void> StatePlaying::RemotePeerManager::SendRequestToGenerator(std::string request)
+cr::TaskHandle<void> StatePlaying::RemotePeerManager::SendRequestToGenerator(
+   std::string request,
+   SendResult firstResult)
 {
    for (unsigned attempt = REQUEST_ATTEMPTS; attempt > 0; --attempt) {
-      co_await Send(request);
-      co_await m_timer.WaitFor(1s);
       if (!m_pendingRequest)
          co_return;
+      co_await Send(request, std::exchange(firstResult, std::nullopt));
+      co_await m_timer.After(1s);
    }
-   m_renegotiate();
+   if (m_pendingRequest)
+      m_renegotiate();
 }
 
-cr::TaskHandle<void> StatePlaying::RemotePeerManager::Send(std::string message)
+cr::TaskHandle<void> StatePlaying::RemotePeerManager::Send(std::string message,
+                                                           SendResult firstResult)
 {
-   if (message.size() > cmd::SendLongMessage::MAX_BUFFER_SIZE) {
+   if (message.size() > cmd::SendMessage::MAX_BUFFER_SIZE) {
       m_proxy.FireAndForget<cmd::ShowToast>("Cannot send too long message, try fewer dices", 7s);
       co_return;
    }
@@ -138,14 +186,17 @@ cr::TaskHandle<void> StatePlaying::RemotePeerManager::Send(std::string message)
 
    do {
       cmd::SendMessageResponse response;
-      if (message.size() <= cmd::SendMessage::MAX_BUFFER_SIZE)
-         response = co_await m_proxy.Command<cmd::SendMessage>(message, m_remote.mac);
+      if (firstResult)
+         response = *std::exchange(firstResult, std::nullopt);
       else
-         response = co_await m_proxy.Command<cmd::SendLongMessage>(message, m_remote.mac);
+         response = co_await m_proxy.CommandWithTimeout<cmd::SendMessage>(SEND_TIMEOUT,
+                                                                          message,
+                                                                          m_remote.mac);
 
       switch (response) {
       case cmd::SendMessageResponse::INVALID_STATE:
       case cmd::SendMessageResponse::INTEROP_FAILURE:
+      case cmd::SendMessageResponse::TIMEOUT:
          break;
       case cmd::SendMessageResponse::OK:
          m_connected = true;
@@ -232,20 +283,15 @@ void StatePlaying::OnMessageReceived(const bt::Device & sender, const std::strin
          if (Matches(*response, m_pendingRequest.get()))
             m_pendingRequest = nullptr;
          mgr->second.OnReceptionSuccess(m_pendingRequest == nullptr);
-         StartRootTask(ShowResponse(*response, mgr->second.GetDevice().name));
+         StartRootTask(ShowResponse(std::move(*response), mgr->second.GetDevice().name));
          return;
       }
 
       if (auto * request = std::get_if<dice::Request>(&parsed)) {
          mgr->second.OnReceptionSuccess(m_pendingRequest == nullptr);
          StartRootTask(ShowRequest(*request, mgr->second.GetDevice().name));
-         if (m_localGenerator) {
-            dice::Response response = GenerateResponse(*m_ctx.generator, std::move(*request));
-            std::string encoded = m_ctx.serializer->Serialize(response);
-            for (auto & [_, peer] : m_managers)
-               peer.SendResponse(encoded);
-            StartRootTask(ShowResponse(response, "You"));
-         }
+         if (m_localGenerator)
+            Respond(std::move(*request));
          return;
       }
    }
@@ -258,19 +304,12 @@ void StatePlaying::OnCastRequest(dice::Request && localRequest)
 {
    StartRootTask(ShowRequest(localRequest, "You"));
 
-   std::string encodedRequest = m_ctx.serializer->Serialize(localRequest);
-   for (auto & [_, mgr] : m_managers)
-      mgr.SendRequest(encodedRequest);
+   StartRootTask(Broadcast(m_ctx.serializer->Serialize(localRequest), true));
 
-   if (m_localGenerator) {
-      dice::Response response = GenerateResponse(*m_ctx.generator, std::move(localRequest));
-      std::string encodedResponse = m_ctx.serializer->Serialize(response);
-      for (auto & [_, mgr] : m_managers)
-         mgr.SendResponse(encodedResponse);
-      StartRootTask(ShowResponse(response, "You"));
-   } else {
+   if (m_localGenerator)
+      Respond(std::move(localRequest));
+   else
       m_pendingRequest = std::make_unique<dice::Request>(std::move(localRequest));
-   }
 }
 
 void StatePlaying::OnGameStopped()
@@ -286,6 +325,26 @@ void StatePlaying::OnSocketReadFailure(const bt::Device & transmitter)
       mgr->second.OnReceptionFailure();
 }
 
+void StatePlaying::Respond(dice::Request && request)
+{
+   const size_t size = GetSize(request.cast);
+   if (size <= MAX_SHOWN_AT_ONCE) {
+      dice::Response response = GenerateResponse(*m_ctx.generator, std::move(request));
+      StartRootTask(Broadcast(m_ctx.serializer->Serialize(response), false));
+      StartRootTask(ShowResponse(std::move(response), "You"));
+      return;
+   }
+   // far beyond what a message can carry, so it is only shown here, as it is rolled
+   m_ctx.proxy.FireAndForget<cmd::ShowToast>("Cannot send too long message, try fewer dices", 7s);
+   StartRootTask(ShowResponse(GenerateInPieces(*m_ctx.generator,
+                                               dice::TypeToString(request.cast),
+                                               size,
+                                               request.threshold,
+                                               MAX_SHOWN_AT_ONCE),
+                              size,
+                              "You"));
+}
+
 void StatePlaying::StartNegotiation()
 {
    std::unordered_set<bt::Device> peers;
@@ -307,6 +366,50 @@ void StatePlaying::StartNegotiationWithOffer(const bt::Device & sender, const st
    Context::SwitchToState<StateNegotiating>(m_ctx, std::move(peers), m_localMac, sender, offer);
 }
 
+cr::TaskHandle<void> StatePlaying::Broadcast(std::string message, bool isRequest)
+{
+   if (message.size() > cmd::SendMulticast::MAX_BUFFER_SIZE) {
+      m_ctx.proxy.FireAndForget<cmd::ShowToast>("Cannot send too long message, try fewer dices",
+                                                7s);
+      co_return;
+   }
+
+   std::vector<std::string> recipients;
+   recipients.reserve(m_managers.size());
+   for (auto & [mac, mgr] : m_managers) {
+      recipients.emplace_back(mac);
+      if (isRequest)
+         mgr.ExpectResponse();
+   }
+   // the generator might renegotiate, so it must be notified last
+   std::stable_partition(std::begin(recipients), std::end(recipients), [this](const auto & mac) {
+      return !m_managers.at(mac).IsGenerator();
+   });
+
+   constexpr size_t MAX_CHUNK = cmd::SendMulticast::MAX_RECIPIENTS;
+   std::vector<cmd::SendMessageResponse> results(recipients.size());
+   for (size_t offset = 0; offset < recipients.size(); offset += MAX_CHUNK) {
+      const auto chunk = std::span<const std::string>(recipients).subspan(
+         offset,
+         std::min(recipients.size() - offset, MAX_CHUNK));
+
+      const auto response =
+         co_await m_ctx.proxy.CommandWithTimeout<cmd::SendMulticast>(SEND_TIMEOUT, message, chunk);
+      for (size_t i = 0; i < chunk.size(); ++i)
+         results[offset + i] = cmd::GetRecipientResponse(response, i);
+   }
+
+   for (size_t i = 0; i < recipients.size(); ++i) {
+      auto mgr = m_managers.find(recipients[i]);
+      if (mgr == std::end(m_managers))
+         continue;
+      if (isRequest)
+         mgr->second.SendRequest(message, results[i]);
+      else
+         mgr->second.SendResponse(message, results[i]);
+   }
+}
+
 cr::TaskHandle<void> StatePlaying::ShowRequest(const dice::Request & request,
                                                const std::string & from)
 {
@@ -322,14 +425,11 @@ cr::TaskHandle<void> StatePlaying::ShowRequest(const dice::Request & request,
       OnGameStopped();
 }
 
-cr::TaskHandle<void> StatePlaying::ShowResponse(const dice::Response & response,
-                                                const std::string & from)
+cr::TaskHandle<void> StatePlaying::ShowResponse(dice::Response response, std::string from)
 {
-   const size_t responseSize = response.cast.Apply([](const auto & vec) {
-      return vec.size();
-   });
+   const size_t responseSize = GetSize(response.cast);
 
-   if (responseSize > cmd::ShowLongResponse::MAX_BUFFER_SIZE / 3) {
+   if (responseSize > MAX_SHOWN_AT_ONCE) {
       m_ctx.proxy.FireAndForget<cmd::ShowToast>("Request is too big, cannot proceed", 7s);
       co_return;
    }
@@ -356,4 +456,30 @@ cr::TaskHandle<void> StatePlaying::ShowResponse(const dice::Response & response,
       StartNegotiation();
 }
 
+cr::TaskHandle<void> StatePlaying::ShowResponse(cr::AsyncGenerator<dice::Response> pieces,
+                                                size_t size,
+                                                std::string from)
+{
+   // the next piece is rolled only once the previous one is shown, the success count goes with
+   // the last one
+   cmd::ShowResponseResponse responseCode = cmd::ShowResponseResponse::OK;
+   size_t shown = 0;
+   while (responseCode == cmd::ShowResponseResponse::OK) {
+      const auto piece = co_await pieces.Next();
+      if (!piece)
+         break;
+      shown += GetSize(piece->cast);
+      responseCode = co_await m_ctx.proxy.Command<cmd::ShowLongResponse>(
+         piece->cast,
+         dice::TypeToString(piece->cast),
+         shown == size ? static_cast<int32_t>(piece->successCount.value_or(-1)) : -1,
+         from);
+   }
+
+   if (responseCode != cmd::ShowResponseResponse::OK)
+      OnGameStopped();
+   else if (++m_responseCount >= ROUNDS_PER_GENERATOR)
+      StartNegotiation();
+}
+
 } // namespace fsm
@@ -5,11 +5,14 @@
 #include "dice/serializer.hpp"
 #include "fsm/context.hpp"
 #include "fsm/statebase.hpp"
+#include "sign/commands.hpp"
 
+#include "utils/asyncgenerator.hpp"
 #include "utils/task.hpp"
 #include "utils/taskowner.hpp"
 
 #include <functional>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -31,14 +34,20 @@ class StatePlaying : public StateBase
       const bt::Device & GetDevice() const;
       bool IsConnected() const;
       bool IsGenerator() const;
-      void SendRequest(const std::string & request);
-      void SendResponse(const std::string & response);
+      // called before the request goes out, so that an early answer is not missed
+      void ExpectResponse();
+      // the first attempt went out in a multicast, resends only if it failed for this peer
+      void SendRequest(const std::string & request, cmd::SendMessageResponse multicastResult);
+      void SendResponse(const std::string & response, cmd::SendMessageResponse multicastResult);
       void OnReceptionSuccess(bool answeredRequest);
       void OnReceptionFailure();
 
    private:
-      [[nodiscard]] cr::TaskHandle<void> SendRequestToGenerator(std::string request);
-      [[nodiscard]] cr::TaskHandle<void> Send(std::string message);
+      using SendResult = std::optional<cmd::SendMessageResponse>;
+
+      [[nodiscard]] cr::TaskHandle<void> SendRequestToGenerator(std::string request,
+                                                                SendResult firstResult);
+      [[nodiscard]] cr::TaskHandle<void> Send(std::string message, SendResult firstResult = {});
 
       bt::Device m_remote;
       core::CommandAdapter & m_proxy;
@@ -65,12 +74,16 @@ public:
    void OnSocketReadFailure(const bt::Device & transmitter) override;
 
 private:
+   void Respond(dice::Request && request);
    void StartNegotiation();
    void StartNegotiationWithOffer(const bt::Device & sender, const std::string & offer);
+   [[nodiscard]] cr::TaskHandle<void> Broadcast(std::string message, bool isRequest);
    [[nodiscard]] cr::TaskHandle<void> ShowRequest(const dice::Request & request,
                                                   const std::string & from);
-   [[nodiscard]] cr::TaskHandle<void> ShowResponse(const dice::Response & response,
-                                                   const std::string & from);
+   [[nodiscard]] cr::TaskHandle<void> ShowResponse(dice::Response response, std::string from);
+   [[nodiscard]] cr::TaskHandle<void> ShowResponse(cr::AsyncGenerator<dice::Response> pieces,
+                                                   size_t size,
+                                                   std::string from);
 
    Context m_ctx;
    const std::string m_localMac;
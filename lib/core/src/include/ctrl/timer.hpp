@@ -2,9 +2,10 @@
 #define TIMER_HPP
 
 #include "utils/task.hpp"
+#include "utils/uniquefunction.hpp"
 
 #include <chrono>
-#include <functional>
+#include <cstdint>
 
 namespace core {
 
@@ -14,18 +15,54 @@ struct Timeout
 class Timer
 {
 public:
+   using Task = UniqueFunction<void()>;
+   using TimerId = uint64_t;
+   static constexpr TimerId NO_TIMER = 0;
+
    template <typename S>
    explicit Timer(S && scheduler)
+      : m_scheduler([s = std::forward<S>(scheduler)](Task && task,
+                                                     std::chrono::milliseconds delay) mutable {
+         s(std::move(task), delay);
+         return NO_TIMER;
+      })
+   {}
+
+   // scheduler returns an id that canceller uses to withdraw the task before it has run
+   template <typename S, typename C>
+   Timer(S && scheduler, C && canceller)
       : m_scheduler(std::forward<S>(scheduler))
+      , m_canceller(std::forward<C>(canceller))
    {}
 
+   class FutureTimeout;
+
+   // destroying the handle before it is done withdraws the scheduled task when possible
    cr::TaskHandle<Timeout> WaitFor(std::chrono::milliseconds delay);
+   // the same without a coroutine frame of its own, for co_await right away
+   FutureTimeout After(std::chrono::milliseconds delay) noexcept;
 
 private:
-   struct FutureTimeout;
+   UniqueFunction<TimerId(Task &&, std::chrono::milliseconds)> m_scheduler;
+   UniqueFunction<bool(TimerId)> m_canceller;
+};
 
-   using Task = std::function<void()>;
-   const std::function<void(Task &&, std::chrono::milliseconds)> m_scheduler;
+class Timer::FutureTimeout
+{
+public:
+   FutureTimeout(Timer & timer, std::chrono::milliseconds timeout) noexcept
+      : m_timer(timer)
+      , m_timeout(timeout)
+   {}
+   bool await_ready() const noexcept { return false; }
+   void await_suspend(stdcr::coroutine_handle<> h);
+   Timeout await_resume() const noexcept { return {}; }
+   bool Withdraw() noexcept;
+
+private:
+   Timer & m_timer;
+   std::chrono::milliseconds m_timeout;
+   TimerId m_id = NO_TIMER;
 };
 
 } // namespace core
@@ -65,6 +65,7 @@ struct Cast : std::variant<D4, D6, D8, D10, D12, D16, D20, D100>
 };
 
 std::span<char> WriteAsText(const Cast & cast, std::span<char> dest);
+std::span<uint8_t> WriteAsBytes(const Cast & cast, std::span<uint8_t> dest);
 
 } // namespace dice
 
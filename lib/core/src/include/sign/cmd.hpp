@@ -2,6 +2,7 @@
 #define SIGN_CMD_HPP
 
 #include <cstdint>
+#include <span>
 #include <string_view>
 
 #define COMMAND_ID(id) (id << 8)
@@ -17,6 +18,7 @@ public:
       OK = 0,
       INVALID_STATE = -1,
       INTEROP_FAILURE = -2,
+      TIMEOUT = -3, // native only, the deadline passed before a response arrived
       BLUETOOTH_OFF = 2,
       LISTEN_FAILED = 3,
       CONNECTION_NOT_FOUND = 4,
@@ -30,6 +32,11 @@ public:
    virtual std::string_view GetName() const = 0;
    virtual size_t GetArgsCount() const = 0;
    virtual std::string_view GetArgAt(size_t index) const = 0;
+   // only the newest command with this id matters, an invoker that is behind may put it off
+   // and drop the older ones
+   virtual bool IsSupersedable() const { return false; }
+   // optional binary form of the args for invokers that can pass it on without formatting
+   virtual std::span<const uint8_t> GetPayload() const { return {}; }
 };
 
 inline std::string_view ToString(ICommand::ResponseCode code)
@@ -39,6 +46,7 @@ inline std::string_view ToString(ICommand::ResponseCode code)
    CASE(OK);
    CASE(INVALID_STATE);
    CASE(INTEROP_FAILURE);
+   CASE(TIMEOUT);
    CASE(BLUETOOTH_OFF);
    CASE(LISTEN_FAILED);
    CASE(CONNECTION_NOT_FOUND);
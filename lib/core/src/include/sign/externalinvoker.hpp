@@ -3,17 +3,36 @@
 
 #include <cstdint>
 #include <memory>
+#include <span>
 
 #include "utils/poolptr.hpp"
 
 namespace cmd {
 class ICommand;
 
+struct Invocation
+{
+   mem::pool_ptr<ICommand> cmd;
+   int32_t id;
+};
+
 class IExternalInvoker
 {
 public:
    virtual ~IExternalInvoker() = default;
    virtual bool Invoke(mem::pool_ptr<ICommand> && data, int32_t id) = 0;
+
+   // returns the number of leading commands that were accepted, the rest are considered failed
+   virtual size_t InvokeBatch(std::span<Invocation> batch)
+   {
+      size_t accepted = 0;
+      for (auto & [cmd, id] : batch) {
+         if (!Invoke(std::move(cmd), id))
+            break;
+         ++accepted;
+      }
+      return accepted;
+   }
 };
 
 } // namespace cmd
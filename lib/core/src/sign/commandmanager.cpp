@@ -1,8 +1,12 @@
 #include "sign/commandmanager.hpp"
+#include "sign/commands.hpp"
 #include "sign/externalinvoker.hpp"
+#include "ctrl/timer.hpp"
 
 #include "utils/log.hpp"
 
+#include <bit>
+
 #undef NDEBUG
 #include <cassert>
 
@@ -10,6 +14,28 @@ namespace cmd {
 namespace {
 constexpr int32_t INVALID_CMD_ID = 0;
 constexpr auto TAG = "Command";
+
+template <typename... Ts>
+constexpr auto GetIds(internal::List<Ts...>)
+{
+   return std::array<int32_t, sizeof...(Ts)>{Ts::ID...};
+}
+
+size_t PageIndex(int32_t id)
+{
+   return static_cast<size_t>(id) / COMMAND_ID(1);
+}
+
+size_t SlotIndex(int32_t id)
+{
+   return static_cast<size_t>(id) % COMMAND_ID(1);
+}
+
+uint64_t SlotBit(size_t slot)
+{
+   return uint64_t(1) << (slot % 64U);
+}
+
 } // namespace
 
 
@@ -25,79 +51,299 @@ bool Manager::FutureResponse::await_ready() const noexcept
 
 void Manager::FutureResponse::await_suspend(stdcr::coroutine_handle<> h) const
 {
-   assert(m_mgr.m_pendingCmds.count(m_id) != 0);
-   m_mgr.m_pendingCmds[m_id].callback = h;
+   CommandData * data = m_mgr.FindPending(m_id);
+   assert(data != nullptr);
+   data->callback = h;
 }
 
 int64_t Manager::FutureResponse::await_resume() const
 {
-   const auto it = m_mgr.m_pendingCmds.find(m_id);
-   if (it == std::end(m_mgr.m_pendingCmds))
+   const CommandData * data = m_mgr.FindPending(m_id);
+   if (!data)
       return ICommand::INTEROP_FAILURE;
-   return it->second.response;
+   return data->response;
+}
+
+bool Manager::FutureResponse::Withdraw() noexcept
+{
+   CommandData * data = m_mgr.FindPending(m_id);
+   if (!data || !data->callback)
+      return false;
+   data->callback = nullptr;
+   return true;
 }
 
 Manager::Manager(std::unique_ptr<IExternalInvoker> uiInvoker,
-                 std::unique_ptr<IExternalInvoker> btInvoker)
+                 std::unique_ptr<IExternalInvoker> btInvoker,
+                 core::Timer * timer)
    : m_uiInvoker(std::move(uiInvoker))
    , m_btInvoker(std::move(btInvoker))
+   , m_timer(timer)
 {
    assert(m_uiInvoker);
    assert(m_btInvoker);
+
+   // preallocate storage for all known commands so that issuing them never allocates
+   for (int32_t id : GetIds(internal::UiDictionary{}))
+      GetPage(id, true);
+   for (int32_t id : GetIds(internal::BtDictionary{}))
+      GetPage(id, true);
 }
 
 Manager::~Manager()
 {
-   for (auto it = m_pendingCmds.begin(); it != std::end(m_pendingCmds);
-        it = m_pendingCmds.begin()) {
-      if (it->second.callback)
-         it->second.callback();
-      m_pendingCmds.erase(it);
+   for (int32_t id = FindAnyPending(); id != INVALID_CMD_ID; id = FindAnyPending()) {
+      if (auto callback = FindPending(id)->callback)
+         callback();
+      ReleaseSlot(id);
    }
 }
 
-Manager::FutureResponse Manager::IssueUiCommand(mem::pool_ptr<ICommand> && cmd)
+Manager::FutureResponse Manager::IssueUiCommand(mem::pool_ptr<ICommand> && cmd,
+                                                std::chrono::milliseconds timeout)
 {
-   return IssueCommand(std::move(cmd), *m_uiInvoker);
+   return IssueCommand(std::move(cmd), *m_uiInvoker, timeout);
 }
 
-Manager::FutureResponse Manager::IssueBtCommand(mem::pool_ptr<ICommand> && cmd)
+Manager::FutureResponse Manager::IssueBtCommand(mem::pool_ptr<ICommand> && cmd,
+                                                std::chrono::milliseconds timeout)
 {
-   return IssueCommand(std::move(cmd), *m_btInvoker);
+   return IssueCommand(std::move(cmd), *m_btInvoker, timeout);
 }
 
 Manager::FutureResponse Manager::IssueCommand(mem::pool_ptr<ICommand> && cmd,
-                                              IExternalInvoker & invoker)
+                                              IExternalInvoker & invoker,
+                                              std::chrono::milliseconds timeout)
 {
-   int32_t id = cmd->GetId();
-   while (m_pendingCmds.count(id))
-      ++id;
+   const int32_t id = FindFreeId(cmd->GetId());
 
-   if ((id - cmd->GetId()) >= COMMAND_ID(1)) {
+   if (id == INVALID_CMD_ID) {
       Log::Error(TAG, "Command storage is full for {}", cmd->GetName());
       return FutureResponse(*this, INVALID_CMD_ID);
    }
 
-   if (!invoker.Invoke(std::move(cmd), id)) {
+   GetPage(id, false)->name = cmd->GetName();
+   if (m_batchDepth > 0) {
+      if (m_batchRuns.empty() || m_batchRuns.back().first != &invoker)
+         m_batchRuns.emplace_back(&invoker, 0U);
+      m_batch.push_back(Invocation{std::move(cmd), id});
+      m_batchRuns.back().second = m_batch.size();
+   } else if (!invoker.Invoke(std::move(cmd), id)) {
       Log::Error(TAG, "External Invoker failed");
       return FutureResponse(*this, INVALID_CMD_ID);
    }
 
-   m_pendingCmds[id] = {};
+   TakeSlot(id);
+   if (timeout > NO_TIMEOUT) {
+      assert(m_timer != nullptr);
+      auto & deadline = FindPending(id)->deadline;
+      deadline = ExpireAfter(id, timeout);
+      deadline.Run();
+   }
    return FutureResponse(*this, id);
 }
 
 void Manager::SubmitResponse(int32_t cmdId, int64_t response)
 {
-   const auto it = m_pendingCmds.find(cmdId);
-   if (it == std::end(m_pendingCmds)) {
-      Log::Warning(TAG, "cmd::Manager received response to a non-existing command, ID = {}", cmdId);
+   CommandData * data = FindPending(cmdId);
+   if (!data) {
+      if (ConsumeExpired(cmdId)) {
+         ++m_lateResponses;
+         Log::Info(TAG, "cmd::Manager dropped late response to an expired command, ID = {}", cmdId);
+      } else {
+         Log::Warning(TAG,
+                      "cmd::Manager received response to a non-existing command, ID = {}",
+                      cmdId);
+      }
       return;
    }
-   it->second.response = response;
-   if (it->second.callback)
-      it->second.callback();
-   m_pendingCmds.erase(it);
+   Resolve(cmdId, response);
+}
+
+void Manager::EndBatch()
+{
+   assert(m_batchDepth > 0);
+   // failed commands resume their awaiters, anything they issue goes into the next round
+   while (m_batchDepth == 1 && !m_batch.empty())
+      FlushBatch();
+   --m_batchDepth;
+}
+
+void Manager::FlushBatch()
+{
+   std::vector<int32_t> failedIds;
+   size_t begin = 0;
+   for (auto [invoker, end] : m_batchRuns) {
+      const std::span<Invocation> run(m_batch.data() + begin, end - begin);
+      for (size_t i = invoker->InvokeBatch(run); i < run.size(); ++i)
+         failedIds.push_back(run[i].id);
+      begin = end;
+   }
+   m_batch.clear();
+   m_batchRuns.clear();
+
+   if (!failedIds.empty())
+      Log::Error(TAG, "External Invoker failed {} batched command(s)", failedIds.size());
+   for (int32_t id : failedIds) {
+      if (FindPending(id))
+         Resolve(id, ICommand::INTEROP_FAILURE);
+   }
+}
+
+cr::TaskHandle<void> Manager::ExpireAfter(int32_t id, std::chrono::milliseconds timeout)
+{
+   co_await m_timer->After(timeout);
+   Resolve(id, ICommand::TIMEOUT, true);
+}
+
+void Manager::Resolve(int32_t id, int64_t response, bool expired)
+{
+   SlotPage * page = GetPage(id, false);
+   CommandData * data = FindPending(id);
+   assert(data != nullptr);
+
+   const auto latency = std::chrono::steady_clock::now() - data->issued;
+   const size_t responseSlot = (response >= MIN_RESPONSE && response <= MAX_RESPONSE)
+                                  ? static_cast<size_t>(response - MIN_RESPONSE)
+                                  : RESPONSE_SLOTS - 1;
+   page->latency[responseSlot].Record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(latency).count()));
+
+   data->response = response;
+   if (data->callback)
+      data->callback();
+   ReleaseSlot(id, expired);
+}
+
+std::vector<Manager::LatencyStats> Manager::GetLatencyStats() const
+{
+   std::vector<LatencyStats> result;
+   for (size_t index = 0; index < m_pendingCmds.size(); ++index) {
+      const auto & page = m_pendingCmds[index];
+      if (!page)
+         continue;
+      for (size_t slot = 0; slot < page->latency.size(); ++slot) {
+         if (page->latency[slot].GetCount() == 0)
+            continue;
+         const int64_t response = slot + 1 < RESPONSE_SLOTS
+                                     ? static_cast<int64_t>(slot) + MIN_RESPONSE
+                                     : LatencyStats::OTHER_RESPONSE;
+         result.push_back(LatencyStats{
+            .commandId = static_cast<int32_t>(index * COMMAND_ID(1)),
+            .commandName = page->name,
+            .response = response,
+            .latency = page->latency[slot].GetSnapshot(),
+         });
+      }
+   }
+   return result;
+}
+
+void Manager::LogLatencyStats() const
+{
+   for (const auto & stats : GetLatencyStats()) {
+      Log::Debug(TAG,
+                 "{} {}: count={} p50={}us p90={}us p99={}us max={}us",
+                 stats.commandName,
+                 ToString(static_cast<ICommand::ResponseCode>(stats.response)),
+                 stats.latency.count,
+                 stats.latency.Percentile(50),
+                 stats.latency.Percentile(90),
+                 stats.latency.Percentile(99),
+                 stats.latency.max);
+   }
+}
+
+Manager::SlotPage * Manager::GetPage(int32_t id, bool create)
+{
+   if (id <= INVALID_CMD_ID || PageIndex(id) >= MAX_COMMAND_INDEX)
+      return nullptr;
+   auto & page = m_pendingCmds[PageIndex(id)];
+   if (!page && create)
+      page = std::make_unique<SlotPage>();
+   return page.get();
+}
+
+Manager::CommandData * Manager::FindPending(int32_t id)
+{
+   SlotPage * page = GetPage(id, false);
+   if (!page)
+      return nullptr;
+   const size_t slot = SlotIndex(id);
+   if ((page->takenMask[slot / 64U] & SlotBit(slot)) == 0)
+      return nullptr;
+   return &page->slots[slot];
+}
+
+int32_t Manager::FindFreeId(int32_t cmdId)
+{
+   SlotPage * page = GetPage(cmdId, true);
+   if (!page)
+      return INVALID_CMD_ID;
+   assert(SlotIndex(cmdId) == 0);
+   for (size_t word = 0; word < page->takenMask.size(); ++word) {
+      const uint64_t busy = page->takenMask[word] | page->expiredMask[word];
+      const auto bit = static_cast<size_t>(std::countr_one(busy));
+      if (bit < 64U)
+         return cmdId + static_cast<int32_t>(word * 64U + bit);
+   }
+   // all free slots belong to expired commands, sacrifice their late responses
+   for (size_t word = 0; word < page->takenMask.size(); ++word) {
+      const auto bit = static_cast<size_t>(std::countr_one(page->takenMask[word]));
+      if (bit < 64U)
+         return cmdId + static_cast<int32_t>(word * 64U + bit);
+   }
+   return INVALID_CMD_ID;
+}
+
+void Manager::TakeSlot(int32_t id)
+{
+   SlotPage * page = GetPage(id, false);
+   assert(page != nullptr);
+   const size_t slot = SlotIndex(id);
+   page->takenMask[slot / 64U] |= SlotBit(slot);
+   page->expiredMask[slot / 64U] &= ~SlotBit(slot);
+   page->slots[slot] = {};
+   page->slots[slot].issued = std::chrono::steady_clock::now();
+}
+
+void Manager::ReleaseSlot(int32_t id, bool expired)
+{
+   SlotPage * page = GetPage(id, false);
+   assert(page != nullptr);
+   const size_t slot = SlotIndex(id);
+   page->takenMask[slot / 64U] &= ~SlotBit(slot);
+   if (expired)
+      page->expiredMask[slot / 64U] |= SlotBit(slot);
+   // cancels the deadline if there is one, its frame is freed when the timer fires
+   page->slots[slot].deadline = {};
+}
+
+bool Manager::ConsumeExpired(int32_t id)
+{
+   SlotPage * page = GetPage(id, false);
+   if (!page)
+      return false;
+   const size_t slot = SlotIndex(id);
+   const bool expired = (page->expiredMask[slot / 64U] & SlotBit(slot)) != 0;
+   page->expiredMask[slot / 64U] &= ~SlotBit(slot);
+   return expired;
+}
+
+int32_t Manager::FindAnyPending() const
+{
+   for (size_t index = 0; index < m_pendingCmds.size(); ++index) {
+      const auto & page = m_pendingCmds[index];
+      if (!page)
+         continue;
+      for (size_t word = 0; word < page->takenMask.size(); ++word) {
+         if (page->takenMask[word] != 0) {
+            const auto bit = static_cast<size_t>(std::countr_zero(page->takenMask[word]));
+            return static_cast<int32_t>(index * COMMAND_ID(1) + word * 64U + bit);
+         }
+      }
+   }
+   return INVALID_CMD_ID;
 }
 
 } // namespace cmd
@@ -3,14 +3,26 @@
 
 #include "sign/cmd.hpp"
 #include "utils/coroutine.hpp"
+#include "utils/histogram.hpp"
 #include "utils/poolptr.hpp"
+#include "utils/task.hpp"
 
+#include <array>
+#include <chrono>
 #include <cstdint>
+#include <limits>
 #include <memory>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace core {
+class Timer;
+}
 
 namespace cmd {
 class IExternalInvoker;
+struct Invocation;
 
 class Manager
 {
@@ -21,33 +33,116 @@ public:
       bool await_ready() const noexcept;
       void await_suspend(stdcr::coroutine_handle<> h) const;
       int64_t await_resume() const;
+      // the command stays pending, only its response is no longer delivered
+      bool Withdraw() noexcept;
 
    private:
       Manager & m_mgr;
       const int32_t m_id;
    };
 
+   // commands issued while a scope is alive reach each invoker as a single batch when the
+   // outermost scope ends
+   class BatchScope
+   {
+   public:
+      explicit BatchScope(Manager & mgr) noexcept
+         : m_mgr(mgr)
+      {
+         ++m_mgr.m_batchDepth;
+      }
+      ~BatchScope() { m_mgr.EndBatch(); }
+      BatchScope(const BatchScope &) = delete;
+      BatchScope & operator=(const BatchScope &) = delete;
+
+   private:
+      Manager & m_mgr;
+   };
+
+   // zero timeout means no deadline
+   static constexpr std::chrono::milliseconds NO_TIMEOUT{0};
+
    Manager(std::unique_ptr<IExternalInvoker> uiInvoker,
-           std::unique_ptr<IExternalInvoker> btInvoker);
+           std::unique_ptr<IExternalInvoker> btInvoker,
+           core::Timer * timer = nullptr);
    ~Manager();
 
-   FutureResponse IssueUiCommand(mem::pool_ptr<ICommand> && cmd);
-   FutureResponse IssueBtCommand(mem::pool_ptr<ICommand> && cmd);
+   FutureResponse IssueUiCommand(mem::pool_ptr<ICommand> && cmd,
+                                 std::chrono::milliseconds timeout = NO_TIMEOUT);
+   FutureResponse IssueBtCommand(mem::pool_ptr<ICommand> && cmd,
+                                 std::chrono::milliseconds timeout = NO_TIMEOUT);
 
    void SubmitResponse(int32_t cmdId, int64_t response);
 
-private:
-   FutureResponse IssueCommand(mem::pool_ptr<ICommand> && cmd, IExternalInvoker & invoker);
+   size_t GetLateResponseCount() const noexcept { return m_lateResponses; }
 
-   const std::unique_ptr<IExternalInvoker> m_uiInvoker;
-   const std::unique_ptr<IExternalInvoker> m_btInvoker;
+   // time from issuing a command until its response, in microseconds
+   using LatencyHistogram = stats::Histogram<>;
+   struct LatencyStats
+   {
+      static constexpr int64_t OTHER_RESPONSE = std::numeric_limits<int64_t>::min();
+
+      int32_t commandId;
+      std::string_view commandName;
+      int64_t response; // OTHER_RESPONSE for codes outside ICommand::ResponseCode
+      LatencyHistogram::Snapshot latency;
+   };
+   std::vector<LatencyStats> GetLatencyStats() const;
+   void LogLatencyStats() const;
+
+private:
+   static constexpr size_t SLOTS_PER_COMMAND = COMMAND_ID(1);
+   static constexpr size_t MAX_COMMAND_INDEX = 256U;
 
    struct CommandData
    {
       stdcr::coroutine_handle<> callback = nullptr;
       int64_t response = ICommand::INTEROP_FAILURE;
+      cr::TaskHandle<void> deadline;
+      std::chrono::steady_clock::time_point issued;
+   };
+   static constexpr int64_t MIN_RESPONSE = ICommand::TIMEOUT;
+   static constexpr int64_t MAX_RESPONSE = ICommand::SOCKET_ERROR;
+   // one histogram per known response code plus one for the rest
+   static constexpr size_t RESPONSE_SLOTS = MAX_RESPONSE - MIN_RESPONSE + 2;
+
+   // One page per command type, slot index is the lower byte of the command id.
+   // Expired slots are reused last so that late responses can be recognized and dropped.
+   struct SlotPage
+   {
+      std::array<CommandData, SLOTS_PER_COMMAND> slots;
+      std::array<uint64_t, SLOTS_PER_COMMAND / 64U> takenMask{};
+      std::array<uint64_t, SLOTS_PER_COMMAND / 64U> expiredMask{};
+      std::string_view name;
+      std::array<LatencyHistogram, RESPONSE_SLOTS> latency;
    };
-   std::unordered_map<int32_t, CommandData> m_pendingCmds;
+
+   FutureResponse IssueCommand(mem::pool_ptr<ICommand> && cmd,
+                               IExternalInvoker & invoker,
+                               std::chrono::milliseconds timeout);
+   void EndBatch();
+   void FlushBatch();
+   cr::TaskHandle<void> ExpireAfter(int32_t id, std::chrono::milliseconds timeout);
+   void Resolve(int32_t id, int64_t response, bool expired = false);
+   SlotPage * GetPage(int32_t id, bool create);
+   CommandData * FindPending(int32_t id);
+   int32_t FindFreeId(int32_t cmdId);
+   void TakeSlot(int32_t id);
+   void ReleaseSlot(int32_t id, bool expired = false);
+   bool ConsumeExpired(int32_t id);
+   int32_t FindAnyPending() const;
+
+   const std::unique_ptr<IExternalInvoker> m_uiInvoker;
+   const std::unique_ptr<IExternalInvoker> m_btInvoker;
+   core::Timer * const m_timer;
+   size_t m_lateResponses = 0U;
+
+   unsigned m_batchDepth = 0U;
+   // queued commands in issue order, split into runs of consecutive commands for one invoker
+   std::vector<Invocation> m_batch;
+   std::vector<std::pair<IExternalInvoker *, size_t /*end*/>> m_batchRuns;
+
+   std::array<std::unique_ptr<SlotPage>, MAX_COMMAND_INDEX> m_pendingCmds;
 };
 
 } // namespace cmd
@@ -0,0 +1,25 @@
+#include "sign/commandpool.hpp"
+
+#include "utils/log.hpp"
+
+namespace cmd {
+namespace {
+constexpr auto TAG = "Mempool";
+} // namespace
+
+void LogPoolStats()
+{
+   for (const mem::SizeClassStats & s : pool.GetStats()) {
+      Log::Debug(TAG,
+                 "Block size {}: count={} live={} peak={} misses={} probes/allocs={}/{}",
+                 s.blockSize,
+                 s.blockCount,
+                 s.liveBlocks,
+                 s.highWaterMark,
+                 s.misses,
+                 s.probes,
+                 s.allocations);
+   }
+}
+
+} // namespace cmd
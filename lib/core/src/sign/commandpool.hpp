@@ -25,6 +25,8 @@ using CommandPool =
 
 inline CommandPool pool(COMMAND_MEMPOOL_INITIAL_BLOCK_COUNT);
 
+void LogPoolStats();
+
 } // namespace cmd
 
 #endif // SIGN_COMMANDPOOL_HPP
@@ -2,6 +2,7 @@
 
 #include "utils/format.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <climits>
@@ -36,12 +37,18 @@ namespace cmd {
 template <typename TTraits>
 Base<TTraits>::Base(ParamTuple params)
 {
-   if constexpr (ARG_SIZE > 0) {
+   if constexpr (OWNS_LONG_ARG) {
+      m_longArgs = std::move(std::get<0>(params));
+   } else if constexpr (ARG_SIZE > 0) {
       WriteToBuffer(std::get<0>(params), {std::get<0>(m_longArgs)});
    }
    if constexpr (ARG_SIZE > 1) {
       FillCharArrays(params, m_shortArgs, std::make_index_sequence<ARG_SIZE - 1>{});
    }
+   if constexpr (PAYLOAD_SIZE > 0) {
+      const auto rest = dice::WriteAsBytes(std::get<0>(params), m_payload.bytes);
+      m_payload.size = m_payload.bytes.size() - rest.size();
+   }
 }
 
 template <typename TTraits>
@@ -62,23 +69,88 @@ std::string_view Base<TTraits>::GetArgAt(size_t index) const noexcept
    const char * buffer;
    switch (index) {
    case 0:
-      assert(index < m_longArgs.size());
-      buffer = m_longArgs[index].data();
-      if constexpr (MAX_BUFFER_SIZE <= UCHAR_MAX) {
-         assert(static_cast<size_t>(*buffer) <= m_longArgs[index].size());
-         return std::string_view(buffer + 1, static_cast<size_t>(*buffer));
+      if constexpr (OWNS_LONG_ARG) {
+         return m_longArgs;
+      } else if constexpr (MAX_BUFFER_SIZE <= UCHAR_MAX) {
+         assert(index < m_longArgs.size());
+         buffer = m_longArgs[index].data();
+         const auto length = static_cast<unsigned char>(*buffer);
+         assert(length <= m_longArgs[index].size());
+         return std::string_view(buffer + 1, length);
       } else {
+         assert(index < m_longArgs.size());
+         buffer = m_longArgs[index].data();
          assert(std::string_view(buffer + 1).size() <= m_longArgs[index].size());
          return std::string_view(buffer + 1);
       }
    default:
       assert(index - 1 < m_shortArgs.size());
       buffer = m_shortArgs[index - 1].data();
-      assert(static_cast<size_t>(*buffer) <= m_shortArgs[index - 1].size());
-      return std::string_view(buffer + 1, static_cast<size_t>(*buffer));
+      const auto length = static_cast<unsigned char>(*buffer);
+      assert(length <= m_shortArgs[index - 1].size());
+      return std::string_view(buffer + 1, length);
    }
 }
 
+template <typename TTraits>
+bool Base<TTraits>::IsSupersedable() const noexcept
+{
+   return TTraits::SUPERSEDABLE;
+}
+
+template <typename TTraits>
+std::span<const uint8_t> Base<TTraits>::GetPayload() const noexcept
+{
+   if constexpr (PAYLOAD_SIZE > 0)
+      return std::span(m_payload.bytes).first(m_payload.size);
+   else
+      return {};
+}
+
+template <typename TTraits>
+MulticastBase<TTraits>::MulticastBase(std::string message,
+                                      std::span<const std::string> recipients)
+   : m_message(std::move(message))
+   , m_recipientCount(std::min(recipients.size(), MAX_RECIPIENTS))
+{
+   assert(recipients.size() <= MAX_RECIPIENTS);
+   for (size_t i = 0; i < m_recipientCount; ++i)
+      WriteToBuffer(recipients[i], {m_recipients[i]});
+}
+
+template <typename TTraits>
+int32_t MulticastBase<TTraits>::GetId() const noexcept
+{
+   return ID;
+}
+
+template <typename TTraits>
+size_t MulticastBase<TTraits>::GetArgsCount() const noexcept
+{
+   return 1U + m_recipientCount;
+}
+
+template <typename TTraits>
+std::string_view MulticastBase<TTraits>::GetArgAt(size_t index) const noexcept
+{
+   if (index == 0)
+      return m_message;
+   assert(index - 1 < m_recipientCount);
+   const char * buffer = m_recipients[index - 1].data();
+   assert(static_cast<size_t>(*buffer) <= m_recipients[index - 1].size());
+   return std::string_view(buffer + 1, static_cast<size_t>(*buffer));
+}
+
+#define INSTANTIATE_MULTICAST(name)                                       \
+   template <>                                                            \
+   std::string_view MulticastBase<name##Traits>::GetName() const noexcept \
+   {                                                                      \
+      return #name;                                                       \
+   }                                                                      \
+   template class MulticastBase<name##Traits>
+
+INSTANTIATE_MULTICAST(SendMulticast);
+
 #define INSTANTIATE(name)                                        \
    template <>                                                   \
    std::string_view Base<name##Traits>::GetName() const noexcept \
@@ -96,7 +168,6 @@ INSTANTIATE(EnableBluetooth);
 INSTANTIATE(NegotiationStart);
 INSTANTIATE(NegotiationStop);
 INSTANTIATE(SendMessage);
-INSTANTIATE(SendLongMessage);
 INSTANTIATE(ShowAndExit);
 INSTANTIATE(ShowToast);
 INSTANTIATE(ShowNotification);
@@ -6,12 +6,37 @@
 #include <array>
 #include <chrono>
 #include <cstdint>
+#include <span>
+#include <string>
 #include <string_view>
 #include <tuple>
 #include <type_traits>
 #include "dice/cast.hpp"
 
 namespace cmd {
+namespace internal {
+
+// a leading std::string parameter is moved into the command instead of being formatted
+template <typename T>
+struct OwnsFirstParam : std::false_type
+{};
+
+template <typename... Ts>
+struct OwnsFirstParam<std::tuple<std::string, Ts...>> : std::true_type
+{};
+
+template <size_t Size>
+struct Payload
+{
+   std::array<uint8_t, Size> bytes{};
+   size_t size = 0;
+};
+
+template <>
+struct Payload<0U>
+{};
+
+} // namespace internal
 
 template <typename TTraits>
 class Base : public ICommand
@@ -28,6 +53,8 @@ public:
    static constexpr int32_t ID = TTraits::ID;
    static constexpr size_t ARG_SIZE = std::tuple_size_v<ParamTuple>;
    static constexpr size_t MAX_BUFFER_SIZE = TTraits::LONG_BUFFER_SIZE - 1;
+   static constexpr bool OWNS_LONG_ARG = internal::OwnsFirstParam<ParamTuple>::value;
+   static constexpr size_t PAYLOAD_SIZE = TTraits::PAYLOAD_SIZE;
 
 
    template <typename... Ts>
@@ -40,10 +67,43 @@ public:
    std::string_view GetName() const noexcept override;
    size_t GetArgsCount() const noexcept override;
    std::string_view GetArgAt(size_t index) const noexcept override;
+   bool IsSupersedable() const noexcept override;
+   std::span<const uint8_t> GetPayload() const noexcept override;
 
 private:
-   std::array<LongBuffer, (ARG_SIZE != 0)> m_longArgs{};
+   using LongArgs =
+      std::conditional_t<OWNS_LONG_ARG, std::string, std::array<LongBuffer, (ARG_SIZE != 0)>>;
+
+   LongArgs m_longArgs{};
    std::array<ShortBuffer, (ARG_SIZE > 1) ? (ARG_SIZE - 1) : 0U> m_shortArgs{};
+   [[no_unique_address]] internal::Payload<PAYLOAD_SIZE> m_payload;
+};
+
+
+// one message addressed to several remote devices, args are the message followed by the macs
+template <typename TTraits>
+class MulticastBase : public ICommand
+{
+   static_assert(TTraits::ID >= (100 << 8));
+   using AddressBuffer = std::array<char, TTraits::ADDRESS_BUFFER_SIZE>;
+
+public:
+   using Response = typename TTraits::Response;
+
+   static constexpr int32_t ID = TTraits::ID;
+   static constexpr size_t MAX_BUFFER_SIZE = TTraits::MAX_MESSAGE_SIZE;
+   static constexpr size_t MAX_RECIPIENTS = TTraits::MAX_RECIPIENTS;
+
+   MulticastBase(std::string message, std::span<const std::string> recipients);
+   int32_t GetId() const noexcept override;
+   std::string_view GetName() const noexcept override;
+   size_t GetArgsCount() const noexcept override;
+   std::string_view GetArgAt(size_t index) const noexcept override;
+
+private:
+   std::string m_message;
+   std::array<AddressBuffer, MAX_RECIPIENTS> m_recipients{};
+   size_t m_recipientCount;
 };
 
 
@@ -55,13 +115,16 @@ struct Traits
    static constexpr int32_t ID = Id;
    using Command = Base<Traits<Id, TResponse, TParams...>>;
    using Response = TResponse;
-   using ParamTuple = std::tuple<
-      std::conditional_t<(!std::is_trivially_copyable_v<TParams> || sizeof(TParams) > 16U),
-                         const TParams &,
-                         TParams>...>;
+   using ParamTuple = std::tuple<std::conditional_t<
+      (!std::is_same_v<TParams, std::string> &&
+       (!std::is_trivially_copyable_v<TParams> || sizeof(TParams) > 16U)),
+      const TParams &,
+      TParams>...>;
 
    static constexpr size_t LONG_BUFFER_SIZE = 32U;
    static constexpr size_t SHORT_BUFFER_SIZE = 24U;
+   static constexpr bool SUPERSEDABLE = false;
+   static constexpr size_t PAYLOAD_SIZE = 0U;
 };
 
 template <int32_t Id, typename TResponse, typename... TParams>
@@ -78,16 +141,47 @@ struct ExtraLongTraits : Traits<Id, TResponse, TParams...>
    static constexpr size_t SHORT_BUFFER_SIZE = 32U;
 };
 
+template <int32_t Id, typename TResponse>
+struct MulticastTraits
+{
+   static_assert(sizeof(TResponse) >= sizeof(int64_t));
+
+   static constexpr int32_t ID = Id;
+   using Command = MulticastBase<MulticastTraits<Id, TResponse>>;
+   using Response = TResponse;
+
+   static constexpr size_t MAX_MESSAGE_SIZE = 1023U;
+   static constexpr size_t ADDRESS_BUFFER_SIZE = 24U;
+   static constexpr size_t MAX_RECIPIENTS = 7U; // active devices in a bluetooth piconet
+};
+
+// see ICommand::IsSupersedable()
+template <typename TTraits>
+struct SupersedableTraits : TTraits
+{
+   static constexpr bool SUPERSEDABLE = true;
+};
+
+// a leading dice::Cast is also available as one byte per die through GetPayload()
+template <typename TTraits>
+struct CastPayloadTraits : TTraits
+{
+   static_assert(std::is_same_v<std::tuple_element_t<0, typename TTraits::ParamTuple>,
+                                const dice::Cast &>);
+   static constexpr size_t PAYLOAD_SIZE = TTraits::LONG_BUFFER_SIZE / 3;
+};
+
 
 // clang-format off
 
 // command IDs must be in sync with interop/Command.java
-// the largest parameter type must be first
+// the largest parameter type must be first, std::string is moved in and stored as is
 
 #define RESPONSE_CODE(name) name = ICommand::name
 
 #define COMMON_RESPONSES \
-   RESPONSE_CODE(OK), RESPONSE_CODE(INVALID_STATE), RESPONSE_CODE(INTEROP_FAILURE)
+   RESPONSE_CODE(OK), RESPONSE_CODE(INVALID_STATE), RESPONSE_CODE(INTEROP_FAILURE), \
+   RESPONSE_CODE(TIMEOUT)
 
 
 enum class StartListeningResponse : int64_t {
@@ -179,17 +273,22 @@ enum class SendMessageResponse : int64_t {
    RESPONSE_CODE(CONNECTION_NOT_FOUND),
    RESPONSE_CODE(SOCKET_ERROR),
 };
-using SendMessageTraits = LongTraits<
+using SendMessageTraits = ExtraLongTraits<
    COMMAND_ID(108),
    SendMessageResponse,
-   std::string_view/*message*/, std::string_view/*remote mac addr*/>;
+   std::string/*message*/, std::string_view/*remote mac addr*/>;
 using SendMessage = Base<SendMessageTraits>;
 
-using SendLongMessageTraits = ExtraLongTraits<
-   COMMAND_ID(108),
-   SendMessageResponse,
-   std::string_view/*message*/, std::string_view/*remote mac addr*/>;
-using SendLongMessage = Base<SendLongMessageTraits>;
+
+// OK if delivered to everyone, negative if the command as a whole failed,
+// otherwise one SendMessageResponse per recipient, see GetRecipientResponse()
+enum class SendMulticastResponse : int64_t {
+   COMMON_RESPONSES,
+};
+using SendMulticastTraits = MulticastTraits<
+   COMMAND_ID(116),
+   SendMulticastResponse>;
+using SendMulticast = MulticastBase<SendMulticastTraits>;
 
 
 enum class ShowAndExitResponse : int64_t {
@@ -205,20 +304,20 @@ using ShowAndExit = Base<ShowAndExitTraits>;
 enum class ShowToastResponse : int64_t {
    COMMON_RESPONSES,
 };
-using ShowToastTraits = Traits<
+using ShowToastTraits = SupersedableTraits<Traits<
    COMMAND_ID(110),
    ShowToastResponse,
-   std::string_view, std::chrono::seconds>;
+   std::string_view, std::chrono::seconds>>;
 using ShowToast = Base<ShowToastTraits>;
 
 
 enum class ShowNotificationResponse : int64_t {
    COMMON_RESPONSES,
 };
-using ShowNotificationTraits = Traits<
+using ShowNotificationTraits = SupersedableTraits<Traits<
    COMMAND_ID(111),
    ShowNotificationResponse,
-   std::string_view>;
+   std::string_view>>;
 using ShowNotification = Base<ShowNotificationTraits>;
 
 
@@ -235,16 +334,16 @@ using ShowRequest = Base<ShowRequestTraits>;
 enum class ShowResponseResponse : int64_t {
    COMMON_RESPONSES,
 };
-using ShowResponseTraits = LongTraits<
+using ShowResponseTraits = CastPayloadTraits<LongTraits<
    COMMAND_ID(113),
    ShowResponseResponse,
-   dice::Cast/*numbers*/, std::string_view/*type*/, int32_t/*success count, -1=not set*/, std::string_view/*name*/>;
+   dice::Cast/*numbers*/, std::string_view/*type*/, int32_t/*success count, -1=not set*/, std::string_view/*name*/>>;
 using ShowResponse = Base<ShowResponseTraits>;
 
-using ShowLongResponseTraits = ExtraLongTraits<
+using ShowLongResponseTraits = CastPayloadTraits<ExtraLongTraits<
    COMMAND_ID(113),
    ShowResponseResponse,
-   dice::Cast/*numbers*/, std::string_view/*type*/, int32_t/*success count, -1=not set*/, std::string_view/*name*/>;
+   dice::Cast/*numbers*/, std::string_view/*type*/, int32_t/*success count, -1=not set*/, std::string_view/*name*/>>;
 using ShowLongResponse = Base<ShowLongResponseTraits>;
 
 
@@ -282,7 +381,7 @@ using BtDictionary = List<
    StopDiscovery,
    CloseConnection,
    SendMessage,
-   SendLongMessage,
+   SendMulticast,
    ResetConnections>;
 
 using UiDictionary = List<
@@ -322,6 +421,17 @@ struct Contains<List<U, Ts...>, T>
 } // namespace internal
 
 
+// each recipient gets a signed 4-bit code, in the order of the multicast args
+inline SendMessageResponse GetRecipientResponse(SendMulticastResponse response, size_t index)
+{
+   const auto packed = static_cast<int64_t>(response);
+   if (packed < 0)
+      return static_cast<SendMessageResponse>(packed);
+   const int64_t code = (packed >> (index * 4U)) & 0xF;
+   return static_cast<SendMessageResponse>((code ^ 0x8) - 0x8);
+}
+
+
 template <typename T>
 concept BtCommand = internal::Contains<internal::BtDictionary, T>::value;
 
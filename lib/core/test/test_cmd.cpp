@@ -4,9 +4,14 @@
 #include "sign/commands.hpp"
 #include "sign/commandpool.hpp"
 #include "sign/externalinvoker.hpp"
+#include "ctrl/timer.hpp"
 #include "dice/serializer.hpp"
 #include "fakelogger.hpp"
 
+#include <algorithm>
+#include <limits>
+#include <span>
+
 namespace {
 using namespace cmd;
 
@@ -61,6 +66,81 @@ TEST_F(CmdFixture, common_base_stores_arguments_correctly)
    EXPECT_STREQ("Player 1", cmd.GetArgAt(3).data());
 }
 
+TEST_F(CmdFixture, args_longer_than_127_chars_keep_their_length)
+{
+   ShowResponse cmd(dice::MakeCast("D6", 80), "D6", -1, "Player 1");
+
+   EXPECT_EQ(160U, cmd.GetArgAt(0).size());
+   EXPECT_EQ(cmd.GetArgAt(0).size(), std::string(cmd.GetArgAt(0).data()).size());
+}
+
+TEST_F(CmdFixture, only_ui_notifications_are_supersedable)
+{
+   EXPECT_TRUE(ShowToast("toast", std::chrono::seconds(1)).IsSupersedable());
+   EXPECT_TRUE(ShowNotification("notification").IsSupersedable());
+   EXPECT_FALSE(ShowRequest("D6", 1U, 0U, "Player 1").IsSupersedable());
+   EXPECT_FALSE(SendMessage("message", "mac").IsSupersedable());
+}
+
+TEST_F(CmdFixture, show_response_exposes_cast_as_binary_payload)
+{
+   auto cast = dice::MakeCast("D100", 3);
+   cast.Apply([](auto & vec) {
+      uint32_t value = 98;
+      for (auto & v : vec)
+         v(value++);
+   });
+
+   ShowResponse cmd(cast, "D100", -1, "Player 1");
+
+   EXPECT_EQ(4U, cmd.GetArgsCount());
+   EXPECT_EQ("98;99;100;", cmd.GetArgAt(0));
+   const auto payload = cmd.GetPayload();
+   EXPECT_EQ((std::vector<uint8_t>{98, 99, 100}),
+             std::vector<uint8_t>(payload.begin(), payload.end()));
+
+   ShowToast toast("no payload", std::chrono::seconds(1));
+   EXPECT_TRUE(toast.GetPayload().empty());
+}
+
+TEST_F(CmdFixture, owned_argument_is_moved_in_without_copying)
+{
+   std::string message(SendMessage::MAX_BUFFER_SIZE, 'x');
+   const char * data = message.data();
+
+   auto cmd = pool.MakeUnique<SendMessage>(std::move(message), "5c:b9:01:f8:b6:40");
+
+   EXPECT_EQ(2U, cmd->GetArgsCount());
+   EXPECT_EQ(data, cmd->GetArgAt(0).data());
+   EXPECT_EQ(SendMessage::MAX_BUFFER_SIZE, cmd->GetArgAt(0).size());
+   EXPECT_EQ("5c:b9:01:f8:b6:40", cmd->GetArgAt(1));
+   EXPECT_LT(sizeof(SendMessage), SendMessage::MAX_BUFFER_SIZE);
+}
+
+TEST_F(CmdFixture, multicast_stores_recipients_and_unpacks_their_responses)
+{
+   const std::vector<std::string> macs = {"5c:b9:01:f8:b6:40", "5c:b9:01:f8:b6:41"};
+
+   SendMulticast cmd("hello", macs);
+
+   EXPECT_EQ(SendMulticast::ID, cmd.GetId());
+   EXPECT_STREQ("SendMulticast", cmd.GetName().data());
+   EXPECT_EQ(3U, cmd.GetArgsCount());
+   EXPECT_EQ("hello", cmd.GetArgAt(0));
+   EXPECT_EQ(macs[0], cmd.GetArgAt(1));
+   EXPECT_EQ(macs[1], cmd.GetArgAt(2));
+
+   const auto packed = static_cast<SendMulticastResponse>(
+      (ICommand::SOCKET_ERROR << 4) | (ICommand::INVALID_STATE & 0xF));
+   EXPECT_EQ(SendMessageResponse::INVALID_STATE, GetRecipientResponse(packed, 0));
+   EXPECT_EQ(SendMessageResponse::SOCKET_ERROR, GetRecipientResponse(packed, 1));
+   EXPECT_EQ(SendMessageResponse::OK, GetRecipientResponse(packed, 2));
+
+   const auto failed = SendMulticastResponse::TIMEOUT;
+   EXPECT_EQ(SendMessageResponse::TIMEOUT, GetRecipientResponse(failed, 0));
+   EXPECT_EQ(SendMessageResponse::TIMEOUT, GetRecipientResponse(failed, 1));
+}
+
 // TEST_F(CmdFixture, invalid_response_throws_exception)
 //{
 //   NegotiationStart cmd(MakeCb([&](NegotiationStartResponse r) {
@@ -115,14 +195,17 @@ struct MockExternalInvoker : IExternalInvoker
 class ManagerFixture : public ::testing::Test
 {
 public:
-   ManagerFixture()
+   ManagerFixture() { CreateManager(nullptr); }
+
+   void CreateManager(core::Timer * timer)
    {
       auto uiMockInvoker = std::make_unique<MockExternalInvoker>();
       uiInvoker = uiMockInvoker.get();
       auto btMockInvoker = std::make_unique<MockExternalInvoker>();
       btInvoker = btMockInvoker.get();
 
-      manager = std::make_unique<Manager>(std::move(uiMockInvoker), std::move(btMockInvoker));
+      manager =
+         std::make_unique<Manager>(std::move(uiMockInvoker), std::move(btMockInvoker), timer);
    }
 
    FakeLogger logger;
@@ -288,6 +371,32 @@ TEST_F(ManagerFixture, cmd_manager_returns_error_on_overflow_immediately)
    manager.reset();
 }
 
+TEST_F(ManagerFixture, cmd_manager_reuses_lowest_freed_id_and_accepts_unknown_commands)
+{
+   for (int i = 0; i < 3; ++i)
+      manager->IssueUiCommand(pool.MakeUnique<TestCommand>(ShowToast::ID));
+   EXPECT_EQ(ShowToast::ID + 2, uiInvoker->receivedCommands.back().id);
+
+   manager->SubmitResponse(ShowToast::ID + 1, ICommand::OK);
+   manager->IssueUiCommand(pool.MakeUnique<TestCommand>(ShowToast::ID));
+   EXPECT_EQ(ShowToast::ID + 1, uiInvoker->receivedCommands.back().id);
+
+   manager->IssueUiCommand(pool.MakeUnique<TestCommand>(ShowToast::ID));
+   EXPECT_EQ(ShowToast::ID + 3, uiInvoker->receivedCommands.back().id);
+
+   constexpr int32_t unknownId = COMMAND_ID(42);
+   int64_t response = 0;
+   coawait_and_get_response(
+      [&] {
+         return manager->IssueUiCommand(pool.MakeUnique<TestCommand>(unknownId));
+      },
+      &response);
+   EXPECT_EQ(unknownId, uiInvoker->receivedCommands.back().id);
+   manager->SubmitResponse(unknownId, 42);
+   EXPECT_EQ(42, response);
+   EXPECT_TRUE(logger.NoWarningsOrErrors());
+}
+
 TEST_F(ManagerFixture, cmd_manager_increments_id_for_non_awaited_commands)
 {
    auto sentCmd1 = pool.MakeUnique<TestCommand>(EnableBluetooth::ID);
@@ -384,4 +493,204 @@ TEST_F(ManagerFixture, cmd_manager_erases_canceled_command_once_when_response_ar
    SUCCEED();
 }
 
+TEST_F(ManagerFixture, cmd_manager_times_out_and_drops_late_response)
+{
+   using namespace std::chrono_literals;
+   std::vector<core::Timer::Task> timers;
+   core::Timer timer([&](auto task, std::chrono::milliseconds delay) {
+      EXPECT_EQ(5s, delay);
+      timers.emplace_back(std::move(task));
+   });
+   CreateManager(&timer);
+
+   int64_t response = 0;
+   coawait_and_get_response(
+      [&] {
+         return manager->IssueBtCommand(pool.MakeUnique<TestCommand>(SendMessage::ID), 5s);
+      },
+      &response);
+   ASSERT_EQ(1U, timers.size());
+   EXPECT_EQ(0, response);
+
+   timers.back()();
+   EXPECT_EQ(ICommand::TIMEOUT, response);
+   EXPECT_EQ(0U, manager->GetLateResponseCount());
+
+   // expired id is not reused while there are never-used ones
+   manager->IssueBtCommand(pool.MakeUnique<TestCommand>(SendMessage::ID));
+   EXPECT_EQ(SendMessage::ID + 1, btInvoker->receivedCommands.back().id);
+
+   manager->SubmitResponse(SendMessage::ID, ICommand::OK);
+   EXPECT_EQ(ICommand::TIMEOUT, response);
+   EXPECT_EQ(1U, manager->GetLateResponseCount());
+   EXPECT_TRUE(logger.NoWarningsOrErrors());
+
+   manager->SubmitResponse(SendMessage::ID, ICommand::OK);
+   EXPECT_EQ(1U, manager->GetLateResponseCount());
+   EXPECT_FALSE(logger.NoWarningsOrErrors());
+}
+
+TEST_F(ManagerFixture, cmd_manager_cancels_deadline_when_response_arrives)
+{
+   using namespace std::chrono_literals;
+   std::vector<core::Timer::Task> timers;
+   core::Timer timer([&](auto task, std::chrono::milliseconds) {
+      timers.emplace_back(std::move(task));
+   });
+   CreateManager(&timer);
+
+   int64_t response = 0;
+   coawait_and_get_response(
+      [&] {
+         return manager->IssueUiCommand(pool.MakeUnique<TestCommand>(ShowToast::ID), 1s);
+      },
+      &response);
+   ASSERT_EQ(1U, timers.size());
+
+   manager->SubmitResponse(ShowToast::ID, 42);
+   EXPECT_EQ(42, response);
+
+   timers.back()();
+   EXPECT_EQ(42, response);
+   EXPECT_EQ(0U, manager->GetLateResponseCount());
+   EXPECT_TRUE(logger.NoWarningsOrErrors());
+}
+
+struct CountingExternalInvoker : IExternalInvoker
+{
+   bool Invoke(mem::pool_ptr<cmd::ICommand> && data, int32_t id) override
+   {
+      ++crossings;
+      ids.push_back(id);
+      data.reset();
+      return true;
+   }
+   size_t InvokeBatch(std::span<cmd::Invocation> batch) override
+   {
+      ++crossings;
+      const size_t accepted = std::min(batch.size(), acceptLimit);
+      for (size_t i = 0; i < accepted; ++i)
+         ids.push_back(batch[i].id);
+      return accepted;
+   }
+
+   size_t crossings = 0;
+   size_t acceptLimit = std::numeric_limits<size_t>::max();
+   std::vector<int32_t> ids;
+};
+
+class BatchingFixture : public ::testing::Test
+{
+public:
+   BatchingFixture()
+   {
+      auto uiCountingInvoker = std::make_unique<CountingExternalInvoker>();
+      uiInvoker = uiCountingInvoker.get();
+      auto btCountingInvoker = std::make_unique<CountingExternalInvoker>();
+      btInvoker = btCountingInvoker.get();
+      manager = std::make_unique<Manager>(std::move(uiCountingInvoker),
+                                          std::move(btCountingInvoker));
+   }
+
+   FakeLogger logger;
+   std::unique_ptr<Manager> manager;
+   CountingExternalInvoker * uiInvoker;
+   CountingExternalInvoker * btInvoker;
+};
+
+TEST_F(BatchingFixture, cmd_manager_coalesces_commands_issued_within_scope)
+{
+   constexpr int32_t PEERS = 5;
+   for (int32_t i = 0; i < PEERS; ++i)
+      manager->IssueBtCommand(pool.MakeUnique<TestCommand>(SendMessage::ID));
+   EXPECT_EQ(PEERS, btInvoker->crossings);
+
+   {
+      Manager::BatchScope outer(*manager);
+      {
+         Manager::BatchScope inner(*manager);
+         for (int32_t i = 0; i < PEERS; ++i)
+            manager->IssueBtCommand(pool.MakeUnique<TestCommand>(SendMessage::ID));
+      }
+      manager->IssueUiCommand(pool.MakeUnique<TestCommand>(ShowToast::ID));
+      manager->IssueBtCommand(pool.MakeUnique<TestCommand>(CloseConnection::ID));
+      EXPECT_EQ(PEERS, btInvoker->crossings);
+      EXPECT_EQ(0, uiInvoker->crossings);
+   }
+   EXPECT_EQ(PEERS + 2, btInvoker->crossings);
+   EXPECT_EQ(1, uiInvoker->crossings);
+
+   ASSERT_EQ(2 * PEERS + 1, btInvoker->ids.size());
+   for (int32_t i = 0; i < 2 * PEERS; ++i)
+      EXPECT_EQ(SendMessage::ID + i, btInvoker->ids[i]);
+   EXPECT_EQ(CloseConnection::ID, btInvoker->ids.back());
+   EXPECT_EQ(std::vector<int32_t>{ShowToast::ID}, uiInvoker->ids);
+   EXPECT_TRUE(logger.NoWarningsOrErrors());
+}
+
+TEST_F(BatchingFixture, cmd_manager_fails_rejected_part_of_batch)
+{
+   btInvoker->acceptLimit = 1;
+   std::array<int64_t, 3> responses{};
+   {
+      Manager::BatchScope batch(*manager);
+      for (auto & response : responses) {
+         coawait_and_get_response(
+            [&] {
+               return manager->IssueBtCommand(pool.MakeUnique<TestCommand>(SendMessage::ID));
+            },
+            &response);
+      }
+      EXPECT_EQ((std::array<int64_t, 3>{}), responses);
+   }
+   EXPECT_EQ(1, btInvoker->crossings);
+   EXPECT_EQ(0, responses[0]);
+   EXPECT_EQ(ICommand::INTEROP_FAILURE, responses[1]);
+   EXPECT_EQ(ICommand::INTEROP_FAILURE, responses[2]);
+   EXPECT_FALSE(logger.NoWarningsOrErrors());
+
+   // ids of the rejected commands are free again
+   btInvoker->acceptLimit = std::numeric_limits<size_t>::max();
+   manager->IssueBtCommand(pool.MakeUnique<TestCommand>(SendMessage::ID));
+   EXPECT_EQ(SendMessage::ID + 1, btInvoker->ids.back());
+
+   manager->SubmitResponse(SendMessage::ID, ICommand::OK);
+   EXPECT_EQ(ICommand::OK, responses[0]);
+}
+
+TEST_F(ManagerFixture, cmd_manager_records_latency_per_command_and_response)
+{
+   EXPECT_TRUE(manager->GetLatencyStats().empty());
+
+   for (int i = 0; i < 3; ++i)
+      manager->IssueUiCommand(pool.MakeUnique<TestCommand>(ShowToast::ID));
+   manager->IssueBtCommand(pool.MakeUnique<TestCommand>(SendMessage::ID));
+
+   manager->SubmitResponse(ShowToast::ID, ICommand::OK);
+   manager->SubmitResponse(ShowToast::ID + 1, ICommand::OK);
+   manager->SubmitResponse(ShowToast::ID + 2, 42);
+   manager->SubmitResponse(SendMessage::ID, ICommand::SOCKET_ERROR);
+
+   const auto stats = manager->GetLatencyStats();
+   ASSERT_EQ(3U, stats.size());
+   auto find = [&](int32_t id, int64_t response) {
+      return std::find_if(stats.begin(), stats.end(), [=](const auto & s) {
+         return s.commandId == id && s.response == response;
+      });
+   };
+   auto okToasts = find(ShowToast::ID, ICommand::OK);
+   ASSERT_NE(stats.end(), okToasts);
+   EXPECT_EQ(2U, okToasts->latency.count);
+   EXPECT_EQ("TestCommand", okToasts->commandName);
+   auto otherToasts = find(ShowToast::ID, Manager::LatencyStats::OTHER_RESPONSE);
+   ASSERT_NE(stats.end(), otherToasts);
+   EXPECT_EQ(1U, otherToasts->latency.count);
+   auto failedSends = find(SendMessage::ID, ICommand::SOCKET_ERROR);
+   ASSERT_NE(stats.end(), failedSends);
+   EXPECT_EQ(1U, failedSends->latency.count);
+
+   manager->LogLatencyStats();
+   EXPECT_TRUE(logger.NoWarningsOrErrors());
+}
+
 } // namespace
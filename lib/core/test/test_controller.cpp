@@ -2,6 +2,7 @@
 #include <queue>
 #include <list>
 #include <optional>
+#include <set>
 #include <sstream>
 #include <unordered_set>
 #include <vector>
@@ -14,6 +15,7 @@
 #include "sign/commandpool.hpp"
 #include "sign/externalinvoker.hpp"
 #include "sign/events.hpp"
+#include "utils/virtualscheduler.hpp"
 #include "dice/engine.hpp"
 #include "dice/serializer.hpp"
 
@@ -24,6 +26,22 @@ extern uint32_t g_negotiationRound;
 namespace {
 using namespace std::chrono_literals;
 
+std::set<std::string> GetMacs(const std::vector<bt::Device> & devices)
+{
+   std::set<std::string> macs;
+   for (const auto & device : devices)
+      macs.emplace(device.mac);
+   return macs;
+}
+
+std::set<std::string> GetRecipients(const cmd::ICommand & multicast)
+{
+   std::set<std::string> macs;
+   for (size_t i = 1; i < multicast.GetArgsCount(); ++i)
+      macs.emplace(multicast.GetArgAt(i));
+   return macs;
+}
+
 template <typename... Ts>
 bool Contains(cmd::internal::List<Ts...>, int32_t id)
 {
@@ -94,82 +112,34 @@ private:
 class MockTimerEngine
 {
 public:
-   MockTimerEngine()
-      : m_processing(false)
-   {}
    ~MockTimerEngine() { ExhaustQueue(); }
 
-   void FastForwardTime(std::chrono::seconds sec = 0s)
-   {
-      if (sec == 0s)
-         return ProcessTimers();
-
-      const auto end = m_now + sec;
-      do {
-         m_now += 1s;
-         ProcessTimers();
-      } while (m_now < end);
-   }
+   void FastForwardTime(std::chrono::seconds sec = 0s) { m_scheduler.RunFor(sec); }
 
-   void DumpTimers()
-   {
-      fprintf(stderr, "Dumping timers:\n");
-      for (const auto & t : m_timers)
-         fprintf(stderr,
-                 "- Timer scheduled in %lli ms\n",
-                 (long long)std::chrono::duration_cast<std::chrono::milliseconds>(t.time - m_now)
-                    .count());
-   }
+   void DumpTimers() { fprintf(stderr, "Pending timers: %zu\n", m_scheduler.PendingCount()); }
 
-   void operator()(std::function<void()> && task, std::chrono::milliseconds period)
+   void operator()(core::Timer::Task && task, std::chrono::milliseconds period)
    {
-      //      fprintf(stderr, "Adding timer %d ms\n", (int)period.count());
-      const auto timeToFire = m_now + period;
-      m_timers.push_back({std::move(task), timeToFire});
+      m_scheduler.Schedule(std::move(task), period);
    }
 
-   void ExhaustQueue()
-   {
-      while (!m_timers.empty())
-         FastForwardTime(1s);
-   }
+   void ExhaustQueue() { m_scheduler.RunUntilIdle(); }
 
 private:
-   struct Timer
-   {
-      std::function<void()> task;
-      std::chrono::steady_clock::time_point time;
-   };
-   void ProcessTimers()
-   {
-      if (m_processing)
-         return;
-      m_processing = true;
-      for (auto it = std::begin(m_timers); it != std::end(m_timers);) {
-         if (it->time <= m_now) {
-            it->task();
-            it = m_timers.erase(it);
-         } else {
-            ++it;
-         }
-      }
-      m_processing = false;
-   }
-
-   std::chrono::steady_clock::time_point m_now;
-   std::list<Timer> m_timers;
-   bool m_processing;
+   cr::VirtualScheduler m_scheduler;
 };
 
 class StubGenerator : public dice::IEngine
 {
 public:
    uint32_t value = 3;
+   size_t largestCast = 0;
 
 private:
    void GenerateResult(dice::Cast & cast) override
    {
       cast.Apply([this](auto & vec) {
+         largestCast = std::max(largestCast, vec.size());
          for (auto & e : vec)
             e(value);
       });
@@ -1100,17 +1070,15 @@ TEST_F(P2R8, local_generator_responds_to_remote_and_local_requests)
       RespondOK(showReqId);
 
       const auto expectedResponse = dice::Response{CastFilledWith(3, "D6", 4), 4u};
-      for (const auto & peer : Peers()) {
+      {
          auto [sendResponse, id] = proxy->PopNextCommand();
          ASSERT_TRUE(sendResponse);
-         EXPECT_EQ(cmd::SendMessage::ID, sendResponse->GetId());
-         EXPECT_EQ(2U, sendResponse->GetArgsCount());
+         EXPECT_EQ(cmd::SendMulticast::ID, sendResponse->GetId());
+         EXPECT_EQ(GetMacs(Peers()), GetRecipients(*sendResponse));
 
          const auto actualResponse = serializer->Deserialize(sendResponse->GetArgAt(0));
          EXPECT_TRUE(std::holds_alternative<dice::Response>(actualResponse));
          EXPECT_EQ(expectedResponse, std::get<dice::Response>(actualResponse));
-
-         EXPECT_STREQ(peer.mac.c_str(), sendResponse->GetArgAt(1).data());
          RespondOK(id);
       }
 
@@ -1142,32 +1110,28 @@ TEST_F(P2R8, local_generator_responds_to_remote_and_local_requests)
       RespondOK(showReqId);
 
       const auto expectedRequest = dice::Request{dice::MakeCast("D100", 2), 43};
-      for (const auto & peer : Peers()) {
+      {
          auto [sendRequest, id] = proxy->PopNextCommand();
          ASSERT_TRUE(sendRequest);
-         EXPECT_EQ(cmd::SendMessage::ID, sendRequest->GetId());
-         EXPECT_EQ(2U, sendRequest->GetArgsCount());
+         EXPECT_EQ(cmd::SendMulticast::ID, sendRequest->GetId());
+         EXPECT_EQ(GetMacs(Peers()), GetRecipients(*sendRequest));
 
          const auto actualRequest = serializer->Deserialize(sendRequest->GetArgAt(0));
          EXPECT_TRUE(std::holds_alternative<dice::Request>(actualRequest));
          EXPECT_EQ(expectedRequest, std::get<dice::Request>(actualRequest));
-
-         EXPECT_STREQ(peer.mac.c_str(), sendRequest->GetArgAt(1).data());
          RespondOK(id);
       }
 
       const auto expectedResponse = dice::Response{CastFilledWith(42, "D100", 2), 0u};
-      for (const auto & peer : Peers()) {
+      {
          auto [sendResponse, id] = proxy->PopNextCommand();
          ASSERT_TRUE(sendResponse);
-         EXPECT_EQ(cmd::SendMessage::ID, sendResponse->GetId());
-         EXPECT_EQ(2U, sendResponse->GetArgsCount());
+         EXPECT_EQ(cmd::SendMulticast::ID, sendResponse->GetId());
+         EXPECT_EQ(GetMacs(Peers()), GetRecipients(*sendResponse));
 
          const auto actualResponse = serializer->Deserialize(sendResponse->GetArgAt(0));
          EXPECT_TRUE(std::holds_alternative<dice::Response>(actualResponse));
          EXPECT_EQ(expectedResponse, std::get<dice::Response>(actualResponse));
-
-         EXPECT_STREQ(peer.mac.c_str(), sendResponse->GetArgAt(1).data());
          RespondOK(id);
       }
 
@@ -1199,32 +1163,28 @@ TEST_F(P2R8, local_generator_responds_to_remote_and_local_requests)
       RespondOK(showReqId);
 
       const auto expectedRequest = dice::Request{dice::MakeCast("D100", 2), std::nullopt};
-      for (const auto & peer : Peers()) {
+      {
          auto [sendRequest, id] = proxy->PopNextCommand();
          ASSERT_TRUE(sendRequest);
-         EXPECT_EQ(cmd::SendMessage::ID, sendRequest->GetId());
-         EXPECT_EQ(2U, sendRequest->GetArgsCount());
+         EXPECT_EQ(cmd::SendMulticast::ID, sendRequest->GetId());
+         EXPECT_EQ(GetMacs(Peers()), GetRecipients(*sendRequest));
 
          const auto actualRequest = serializer->Deserialize(sendRequest->GetArgAt(0));
          EXPECT_TRUE(std::holds_alternative<dice::Request>(actualRequest));
          EXPECT_EQ(expectedRequest, std::get<dice::Request>(actualRequest));
-
-         EXPECT_STREQ(peer.mac.c_str(), sendRequest->GetArgAt(1).data());
          RespondOK(id);
       }
 
       const auto expectedResponse = dice::Response{CastFilledWith(42, "D100", 2), std::nullopt};
-      for (const auto & peer : Peers()) {
+      {
          auto [sendResponse, id] = proxy->PopNextCommand();
          ASSERT_TRUE(sendResponse);
-         EXPECT_EQ(cmd::SendMessage::ID, sendResponse->GetId());
-         EXPECT_EQ(2U, sendResponse->GetArgsCount());
+         EXPECT_EQ(cmd::SendMulticast::ID, sendResponse->GetId());
+         EXPECT_EQ(GetMacs(Peers()), GetRecipients(*sendResponse));
 
          const auto actualResponse = serializer->Deserialize(sendResponse->GetArgAt(0));
          EXPECT_TRUE(std::holds_alternative<dice::Response>(actualResponse));
          EXPECT_EQ(expectedResponse, std::get<dice::Response>(actualResponse));
-
-         EXPECT_STREQ(peer.mac.c_str(), sendResponse->GetArgAt(1).data());
          RespondOK(id);
       }
 
@@ -1256,32 +1216,28 @@ TEST_F(P2R8, local_generator_responds_to_remote_and_local_requests)
       RespondOK(showReqId);
 
       const auto expectedRequest = dice::Request{dice::MakeCast("D6", 70), 3u};
-      for (const auto & peer : Peers()) {
+      {
          auto [sendRequest, id] = proxy->PopNextCommand();
          ASSERT_TRUE(sendRequest);
-         EXPECT_EQ(cmd::SendMessage::ID, sendRequest->GetId());
-         EXPECT_EQ(2U, sendRequest->GetArgsCount());
+         EXPECT_EQ(cmd::SendMulticast::ID, sendRequest->GetId());
+         EXPECT_EQ(GetMacs(Peers()), GetRecipients(*sendRequest));
 
          const auto actualRequest = serializer->Deserialize(sendRequest->GetArgAt(0));
          EXPECT_TRUE(std::holds_alternative<dice::Request>(actualRequest));
          EXPECT_EQ(expectedRequest, std::get<dice::Request>(actualRequest));
-
-         EXPECT_STREQ(peer.mac.c_str(), sendRequest->GetArgAt(1).data());
          RespondOK(id);
       }
 
       const auto expectedResponse = dice::Response{CastFilledWith(6, "D6", 70), 70};
-      for (const auto & peer : Peers()) {
+      {
          auto [sendResponse, id] = proxy->PopNextCommand();
          ASSERT_TRUE(sendResponse);
-         EXPECT_EQ(cmd::SendMessage::ID, sendResponse->GetId());
-         EXPECT_EQ(2U, sendResponse->GetArgsCount());
+         EXPECT_EQ(cmd::SendMulticast::ID, sendResponse->GetId());
+         EXPECT_EQ(GetMacs(Peers()), GetRecipients(*sendResponse));
 
          const auto actualResponse = serializer->Deserialize(sendResponse->GetArgAt(0));
          EXPECT_TRUE(std::holds_alternative<dice::Response>(actualResponse));
          EXPECT_EQ(expectedResponse, std::get<dice::Response>(actualResponse));
-
-         EXPECT_STREQ(peer.mac.c_str(), sendResponse->GetArgAt(1).data());
          RespondOK(id);
       }
 
@@ -1334,6 +1290,87 @@ TEST_F(P2R8, local_generator_responds_to_remote_and_local_requests)
    EXPECT_TRUE(proxy->NoCommands());
 }
 
+TEST_F(P2R8, resends_only_to_peers_the_multicast_failed_for)
+{
+   timer->FastForwardTime(2s);
+   EXPECT_TRUE(proxy->NoCommands());
+
+   generator->value = 1;
+   ctrl->OnEvent(event::CastRequestIssued::ID, {"D4", "1"});
+   auto [showRequest, showReqId] = proxy->PopNextCommand();
+   ASSERT_TRUE(showRequest);
+   EXPECT_EQ(cmd::ShowRequest::ID, showRequest->GetId());
+   RespondOK(showReqId);
+
+   auto [sendRequest, sendReqId] = proxy->PopNextCommand();
+   ASSERT_TRUE(sendRequest);
+   EXPECT_EQ(cmd::SendMulticast::ID, sendRequest->GetId());
+   ASSERT_EQ(3U, sendRequest->GetArgsCount());
+   const std::string failedMac(sendRequest->GetArgAt(1));
+   const std::string request(sendRequest->GetArgAt(0));
+   ctrl->OnCommandResponse(sendReqId, cmd::ICommand::INTEROP_FAILURE & 0xF);
+
+   auto [sendResponse, sendRespId] = proxy->PopNextCommand();
+   ASSERT_TRUE(sendResponse);
+   EXPECT_EQ(cmd::SendMulticast::ID, sendResponse->GetId());
+   EXPECT_EQ(GetMacs(Peers()), GetRecipients(*sendResponse));
+
+   auto [showResponse, showRespId] = proxy->PopNextCommand();
+   ASSERT_TRUE(showResponse);
+   EXPECT_EQ(cmd::ShowResponse::ID, showResponse->GetId());
+   RespondOK(showRespId);
+
+   // only the first recipient gets the request again
+   auto [resendRequest, resendReqId] = proxy->PopNextCommand();
+   ASSERT_TRUE(resendRequest);
+   EXPECT_EQ(cmd::SendMessage::ID, resendRequest->GetId());
+   EXPECT_EQ(request, resendRequest->GetArgAt(0));
+   EXPECT_EQ(failedMac, resendRequest->GetArgAt(1));
+   RespondOK(resendReqId);
+
+   // second recipient's slot reports a lost connection, it is not resent
+   ctrl->OnCommandResponse(sendRespId, int64_t(cmd::ICommand::SOCKET_ERROR) << 4);
+   EXPECT_TRUE(proxy->NoCommands());
+}
+
+TEST_F(P2R8, huge_local_response_is_shown_in_chunks_one_at_a_time)
+{
+   constexpr size_t CHUNK = cmd::ShowLongResponse::MAX_BUFFER_SIZE / 3;
+   constexpr size_t SIZE = 2 * CHUNK + 5;
+   timer->FastForwardTime(2s);
+   EXPECT_TRUE(proxy->NoCommands());
+
+   generator->value = 6;
+   ctrl->OnEvent(event::CastRequestIssued::ID, {"D6", std::to_string(SIZE), "6"});
+
+   std::vector<std::pair<std::string, std::string>> chunks; // dice, success count
+   while (!proxy->NoCommands()) {
+      auto [command, id] = proxy->PopNextCommand();
+      ASSERT_TRUE(command);
+      if (command->GetId() == cmd::ShowLongResponse::ID) {
+         // the next piece goes out only after this one is acknowledged
+         EXPECT_TRUE(proxy->NoCommands());
+         EXPECT_STREQ("D6", command->GetArgAt(1).data());
+         EXPECT_STREQ("You", command->GetArgAt(3).data());
+         chunks.emplace_back(command->GetArgAt(0), command->GetArgAt(2));
+      }
+      RespondOK(id);
+   }
+
+   ASSERT_EQ(3U, chunks.size());
+   std::string expected;
+   for (size_t i = 0; i < CHUNK; ++i)
+      expected += "6;";
+   EXPECT_EQ(expected, chunks[0].first);
+   EXPECT_EQ(expected, chunks[1].first);
+   EXPECT_EQ("6;6;6;6;6;", chunks[2].first);
+   EXPECT_EQ("-1", chunks[0].second);
+   EXPECT_EQ("-1", chunks[1].second);
+   EXPECT_EQ(std::to_string(SIZE), chunks[2].second);
+   // the dice are rolled piece by piece, the whole cast is never generated at once
+   EXPECT_EQ(CHUNK, generator->largestCast);
+}
+
 using P2R13 = PlayingFixture<2u, 13u>;
 
 TEST_F(P2R13, remote_generator_is_respected)
@@ -1393,17 +1430,15 @@ TEST_F(P2R13, remote_generator_is_respected)
       RespondOK(showReqId);
 
       const auto expectedRequest = dice::Request{dice::MakeCast("D4", 1), 3u};
-      for (const auto & peer : Peers()) {
+      {
          auto [sendRequest, id] = proxy->PopNextCommand();
          ASSERT_TRUE(sendRequest);
-         EXPECT_EQ(cmd::SendMessage::ID, sendRequest->GetId());
-         EXPECT_EQ(2U, sendRequest->GetArgsCount());
+         EXPECT_EQ(cmd::SendMulticast::ID, sendRequest->GetId());
+         EXPECT_EQ(GetMacs(Peers()), GetRecipients(*sendRequest));
 
          const auto actualRequest = serializer->Deserialize(sendRequest->GetArgAt(0));
          EXPECT_TRUE(std::holds_alternative<dice::Request>(actualRequest));
          EXPECT_EQ(expectedRequest, std::get<dice::Request>(actualRequest));
-
-         EXPECT_STREQ(peer.mac.c_str(), sendRequest->GetArgAt(1).data());
          RespondOK(id);
       }
       EXPECT_TRUE(proxy->NoCommands());
@@ -1532,17 +1567,15 @@ TEST_F(P2R15, renegotiates_when_generator_doesnt_answer_requests)
 
    // sends request
    const auto expectedRequest = dice::Request{dice::MakeCast("D4", 1), 3u};
-   for (const auto & peer : Peers()) {
+   {
       auto [sendRequest, id] = proxy->PopNextCommand();
       ASSERT_TRUE(sendRequest);
-      EXPECT_EQ(cmd::SendMessage::ID, sendRequest->GetId());
-      EXPECT_EQ(2U, sendRequest->GetArgsCount());
+      EXPECT_EQ(cmd::SendMulticast::ID, sendRequest->GetId());
+      EXPECT_EQ(GetMacs(Peers()), GetRecipients(*sendRequest));
 
       const auto actualRequest = serializer->Deserialize(sendRequest->GetArgAt(0));
       EXPECT_TRUE(std::holds_alternative<dice::Request>(actualRequest));
       EXPECT_EQ(expectedRequest, std::get<dice::Request>(actualRequest));
-
-      EXPECT_STREQ(peer.mac.c_str(), sendRequest->GetArgAt(1).data());
       RespondOK(id);
    }
    EXPECT_TRUE(proxy->NoCommands());
@@ -1599,6 +1632,39 @@ TEST_F(P2R15, renegotiates_when_generator_doesnt_answer_requests)
    EXPECT_TRUE(proxy->NoCommands());
 }
 
+TEST_F(P2R15, does_not_resend_request_answered_before_multicast_result)
+{
+   ctrl->OnEvent(event::CastRequestIssued::ID, {"D4", "1", "3"});
+   auto [showRequest, showReqId] = proxy->PopNextCommand();
+   ASSERT_TRUE(showRequest);
+   EXPECT_EQ(cmd::ShowRequest::ID, showRequest->GetId());
+   RespondOK(showReqId);
+
+   auto [sendRequest, sendReqId] = proxy->PopNextCommand();
+   ASSERT_TRUE(sendRequest);
+   EXPECT_EQ(cmd::SendMulticast::ID, sendRequest->GetId());
+   EXPECT_TRUE(proxy->NoCommands());
+
+   // generator answers before the multicast command has completed
+   ctrl->OnEvent(event::MessageReceived::ID,
+                 {R"(<Response successCount="1" size="1" type="D4"><Val>4</Val></Response>)",
+                  Peers()[0].mac,
+                  ""});
+   auto [showResponse, showRespId] = proxy->PopNextCommand();
+   ASSERT_TRUE(showResponse);
+   EXPECT_EQ(cmd::ShowResponse::ID, showResponse->GetId());
+   RespondOK(showRespId);
+
+   RespondOK(sendReqId);
+   EXPECT_TRUE(proxy->NoCommands());
+
+   for (int i = 0; i < 4; ++i) {
+      timer->FastForwardTime(1s);
+      EXPECT_TRUE(proxy->NoCommands());
+   }
+   EXPECT_NE("New state: StateNegotiating", logger.GetLastStateLine());
+}
+
 using P2R17 = PlayingFixture<2u, 17u>;
 
 TEST_F(P2R17, disconnects_peers_that_are_in_error_state_at_the_end)
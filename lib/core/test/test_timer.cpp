@@ -3,13 +3,16 @@
 #include "ctrl/timer.hpp"
 #include "utils/task.hpp"
 
+#include <memory>
+#include <vector>
+
 namespace {
 using namespace std::chrono_literals;
 using core::Timer;
 
 TEST(TimerTest, timer_schedules_delayed_task_correctly)
 {
-   std::function<void()> pendingTask;
+   Timer::Task pendingTask;
    std::chrono::milliseconds requestedDelay;
    bool taskFinished = false;
 
@@ -34,7 +37,7 @@ TEST(TimerTest, timer_schedules_delayed_task_correctly)
 
 TEST(TimerTest, timer_schedules_immediate_task)
 {
-   std::function<void()> pendingTask;
+   Timer::Task pendingTask;
    std::chrono::milliseconds requestedDelay = 123ms;
    bool task1Finished = false;
    bool task2Finished = false;
@@ -67,4 +70,107 @@ TEST(TimerTest, timer_schedules_immediate_task)
    EXPECT_TRUE(task2Finished);
 }
 
+TEST(TimerTest, timer_withdraws_scheduled_task_when_handle_dies)
+{
+   Timer::Task pendingTask;
+   std::vector<Timer::TimerId> cancelled;
+   bool taskFinished = false;
+   bool frameDestroyed = false;
+
+   Timer timer(
+      [&](auto task, std::chrono::milliseconds) {
+         pendingTask = std::move(task);
+         return Timer::TimerId(42);
+      },
+      [&](Timer::TimerId id) {
+         cancelled.push_back(id);
+         return true;
+      });
+
+   auto StartTimer = [&]() -> cr::TaskHandle<void> {
+      std::shared_ptr<void> guard(nullptr, [&](void *) {
+         frameDestroyed = true;
+      });
+      co_await timer.WaitFor(3s);
+      taskFinished = true;
+   };
+
+   auto task = StartTimer();
+   task.Run();
+   EXPECT_TRUE(pendingTask);
+   EXPECT_TRUE(cancelled.empty());
+
+   task = {};
+   EXPECT_EQ(std::vector<Timer::TimerId>{42}, cancelled);
+   EXPECT_TRUE(frameDestroyed);
+   EXPECT_FALSE(taskFinished);
+}
+
+TEST(TimerTest, timer_is_resumed_as_canceled_when_withdrawal_fails)
+{
+   Timer::Task pendingTask;
+   size_t cancelAttempts = 0;
+   bool taskFinished = false;
+
+   Timer timer(
+      [&](auto task, std::chrono::milliseconds) {
+         pendingTask = std::move(task);
+         return Timer::TimerId(42);
+      },
+      [&](Timer::TimerId) {
+         ++cancelAttempts;
+         return false;
+      });
+
+   auto StartTimer = [&]() -> cr::TaskHandle<void> {
+      co_await timer.WaitFor(3s);
+      taskFinished = true;
+   };
+
+   auto task = StartTimer();
+   task.Run();
+   task = {};
+   EXPECT_EQ(1U, cancelAttempts);
+
+   pendingTask();
+   EXPECT_FALSE(taskFinished);
+}
+
+TEST(TimerTest, awaiting_after_resumes_the_caller_directly_and_can_be_withdrawn)
+{
+   Timer::Task pendingTask;
+   std::chrono::milliseconds requestedDelay{0};
+   std::vector<Timer::TimerId> cancelled;
+   size_t finished = 0;
+
+   Timer timer(
+      [&](auto task, std::chrono::milliseconds delay) {
+         pendingTask = std::move(task);
+         requestedDelay = delay;
+         return Timer::TimerId(7);
+      },
+      [&](Timer::TimerId id) {
+         cancelled.push_back(id);
+         return true;
+      });
+
+   auto StartTimer = [&]() -> cr::TaskHandle<void> {
+      co_await timer.After(2s);
+      ++finished;
+   };
+
+   auto task = StartTimer();
+   task.Run();
+   EXPECT_EQ(2s, requestedDelay);
+   pendingTask();
+   EXPECT_EQ(1U, finished);
+   EXPECT_TRUE(cancelled.empty());
+
+   task = StartTimer();
+   task.Run();
+   task = {};
+   EXPECT_EQ(std::vector<Timer::TimerId>{7}, cancelled);
+   EXPECT_EQ(1U, finished);
+}
+
 } // namespace
@@ -1,16 +1,29 @@
 #include "javainvoker.hpp"
 #include "jniexec.hpp"
+#include "common/commandtasks.hpp"
+#include "common/mainexec.hpp"
 
+#include "ctrl/controller.hpp"
 #include "sign/cmd.hpp"
 #include "sign/externalinvoker.hpp"
 
 #include "utils/log.hpp"
 
+#include <span>
+
 namespace jni {
 namespace {
 constexpr auto TAG = "JNI";
+
+void ReportShed(int32_t argId)
+{
+   core::Exec([argId](core::IController * ctrl) {
+      ctrl->OnCommandResponse(argId, cmd::ICommand::INTEROP_FAILURE);
+   });
 }
 
+} // namespace
+
 JavaInvoker::JavaInvoker(JNIEnv & env, jclass localRef, std::string_view methodName)
    : m_env(env)
    , m_class(localRef)
@@ -34,15 +47,28 @@ std::unique_ptr<cmd::IExternalInvoker> JavaInvoker::GetExternalInvoker()
          : parent(parent)
       {}
       bool Invoke(mem::pool_ptr<cmd::ICommand> && cmd, int32_t argId) override
+      {
+         cmd::Invocation invocation{std::move(cmd), argId};
+         return InvokeBatch({&invocation, 1U}) == 1U;
+      }
+      size_t InvokeBatch(std::span<cmd::Invocation> batch) override
       {
          auto javaInvoker = parent.lock();
          if (!javaInvoker)
-            return false;
+            return 0;
 
-         Exec([=, cmd = std::move(cmd)]() mutable {
-            javaInvoker->PassCommand(std::move(cmd), argId);
-         });
-         return true;
+         // the others share one hop onto the JNI worker, supersedable ones go one by one so that
+         // the worker can coalesce or shed them
+         async::ScheduleCommands(
+            batch,
+            [](auto && task, const async::TaskInfo & info) {
+               Exec(std::move(task), info);
+            },
+            [javaInvoker](mem::pool_ptr<cmd::ICommand> && cmd, int32_t argId) {
+               javaInvoker->PassCommand(std::move(cmd), argId);
+            },
+            ReportShed);
+         return batch.size();
       }
       std::weak_ptr<JavaInvoker> parent;
    };
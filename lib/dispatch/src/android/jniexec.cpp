@@ -6,18 +6,16 @@
 #include "ctrl/controller.hpp"
 #include "sign/externalinvoker.hpp"
 
+#include "utils/asynclog.hpp"
 #include "utils/log.hpp"
 #include "utils/task.hpp"
 
 #include <android/log.h>
 #include <jni.h>
-#include <cassert>
 #include <memory>
 #include <string>
 #include <vector>
 
-using namespace std::chrono_literals;
-
 namespace {
 
 constexpr auto TAG = "JNI";
@@ -51,8 +49,7 @@ struct Context
    std::shared_ptr<jni::JavaInvoker> btInvoker;
 };
 
-void ScheduleOnJniWorker(std::function<void(Context &)> && task,
-                         std::chrono::milliseconds delay = 0ms)
+void ScheduleOnJniWorker(async::Worker::Task && task, const async::TaskInfo & info)
 {
    static auto onException = [](std::string_view worker, std::string_view exception) {
       Log::Error(TAG, "Worker {} caught an exception: {}", worker, exception);
@@ -61,12 +58,23 @@ void ScheduleOnJniWorker(std::function<void(Context &)> && task,
       .name = "JNI_WORKER",
       .capacity = std::numeric_limits<size_t>::max(),
       .exceptionHandler = onException,
+      .collectMetrics = true,
+      .metricsLogInterval = std::chrono::minutes(1),
+      // UI notifications can pile up while Java is busy, only the latest of each kind matters
+      .lanes = {{
+         {},
+         {},
+         {},
+         {.capacity = 16, .overflow = async::Worker::Overflow::DROP_OLDEST, .coalesce = true},
+      }},
    });
-   static Context s_ctx{nullptr, nullptr, nullptr, nullptr};
+   s_worker.Schedule(std::move(task), info);
+}
 
-   s_worker.Schedule(delay, [task = std::move(task)] {
-      task(s_ctx);
-   });
+Context & GetJniContext() // jni worker only
+{
+   static Context s_ctx{nullptr, nullptr, nullptr, nullptr};
+   return s_ctx;
 }
 
 
@@ -101,21 +109,9 @@ std::string_view ErrorToString(jint error)
 
 struct JniWorkerScheduler
 {
-   Context * ctx_ = nullptr;
-
    bool await_ready() { return false; }
-   void await_suspend(stdcr::coroutine_handle<> h)
-   {
-      ScheduleOnJniWorker([h, this](Context & ctx) mutable {
-         ctx_ = &ctx;
-         h.resume();
-      });
-   }
-   Context * await_resume()
-   {
-      assert(ctx_);
-      return ctx_;
-   }
+   void await_suspend(stdcr::coroutine_handle<> h) { ScheduleOnJniWorker(h, {.label = "resume"}); }
+   Context * await_resume() { return &GetJniContext(); }
 };
 
 cr::DetachedHandle OnLoad(JavaVM * vm)
@@ -127,6 +123,7 @@ cr::DetachedHandle OnLoad(JavaVM * vm)
    Log::s_warningHandler = LogWarning;
    Log::s_errorHandler = LogError;
    Log::s_fatalHandler = LogFatal;
+   static AsyncLogSink s_logSink({}); // keeps logcat calls off the workers
 
    ctx->jvm = vm;
    auto res = ctx->jvm->AttachCurrentThread(&ctx->jenv, nullptr);
@@ -173,13 +170,13 @@ cr::DetachedHandle SendEvent(JNIEnv * env, jint eventId, jobjectArray args)
       arguments.emplace_back(GetString(env, str));
    }
 
-   core::IController * ctrl = co_await core::Scheduler{};
+   core::IController * ctrl = co_await core::Scheduler{async::Priority::HIGH};
    ctrl->OnEvent(eventId, arguments);
 }
 
 cr::DetachedHandle SendResponse(jint cmdId, jlong result)
 {
-   core::IController * ctrl = co_await core::Scheduler{};
+   core::IController * ctrl = co_await core::Scheduler{async::Priority::CRITICAL};
    ctrl->OnCommandResponse(cmdId, result);
 }
 
@@ -187,11 +184,9 @@ cr::DetachedHandle SendResponse(jint cmdId, jlong result)
 
 namespace jni {
 
-void InternalExec(std::function<void()> task)
+void InternalExec(UniqueFunction<void()> task, const async::TaskInfo & info)
 {
-   ScheduleOnJniWorker([t = std::move(task)](Context &) {
-      t();
-   });
+   ScheduleOnJniWorker(std::move(task), info);
 }
 
 } // namespace jni
@@ -1,19 +1,19 @@
 #ifndef JNI_EXEC_HPP
 #define JNI_EXEC_HPP
 
-#include "utils/alwayscopyable.hpp"
+#include "common/worker.hpp"
 
-#include <functional>
+#include "utils/uniquefunction.hpp"
 
 namespace jni {
 class ICmdManager;
 
-void InternalExec(std::function<void()> task);
+void InternalExec(UniqueFunction<void()> task, const async::TaskInfo & info);
 
 template <typename F>
-void Exec(F && f)
+void Exec(F && f, const async::TaskInfo & info = {.label = "exec"})
 {
-   InternalExec(AlwaysCopyable(std::move(f)));
+   InternalExec(std::forward<F>(f), info);
 }
 
 } // namespace jni
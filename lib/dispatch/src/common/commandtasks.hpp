@@ -0,0 +1,86 @@
+#ifndef ASYNC_COMMANDTASKS_HPP
+#define ASYNC_COMMANDTASKS_HPP
+
+#include "worker.hpp"
+
+#include "sign/cmd.hpp"
+#include "sign/externalinvoker.hpp"
+
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace async {
+
+// supersedable commands go into the low-priority lane, where a newer one of the same kind may
+// replace them and an overflow may shed them
+inline TaskInfo GetTaskInfo(const cmd::ICommand & cmd)
+{
+   if (cmd.IsSupersedable()) {
+      return {
+         .label = "notify",
+         .priority = Priority::LOW,
+         .coalesceKey = static_cast<uint32_t>(cmd.GetId()),
+      };
+   }
+   return {.label = "exec"};
+}
+
+// hands the commands to schedule(task, info) in their order: each supersedable one as a task of
+// its own so that its lane can coalesce or shed it, each run of the others as a single task.
+// pass(cmd, id) is called on the executing thread, onShed(id) for every command whose task is
+// destroyed without running, so that nobody waits for its response forever
+template <typename Schedule, typename Pass, typename OnShed>
+void ScheduleCommands(std::span<cmd::Invocation> batch,
+                      Schedule && schedule,
+                      Pass pass,
+                      OnShed onShed)
+{
+   struct Sheddable
+   {
+      Sheddable(cmd::Invocation && invocation, OnShed onShed)
+         : invocation(std::move(invocation))
+         , onShed(std::move(onShed))
+      {}
+      Sheddable(Sheddable &&) noexcept = default;
+      ~Sheddable()
+      {
+         if (invocation.cmd)
+            onShed(invocation.id);
+      }
+
+      cmd::Invocation invocation;
+      OnShed onShed;
+   };
+
+   std::vector<cmd::Invocation> run;
+   auto scheduleRun = [&] {
+      if (run.empty())
+         return;
+      schedule(
+         [pass, run = std::exchange(run, {})]() mutable {
+            for (auto & [cmd, id] : run)
+               pass(std::move(cmd), id);
+         },
+         TaskInfo{.label = "exec"});
+   };
+
+   for (cmd::Invocation & invocation : batch) {
+      if (!invocation.cmd->IsSupersedable()) {
+         run.push_back(std::move(invocation));
+         continue;
+      }
+      scheduleRun();
+      const TaskInfo info = GetTaskInfo(*invocation.cmd);
+      schedule(
+         [pass, pending = Sheddable(std::move(invocation), onShed)]() mutable {
+            pass(std::move(pending.invocation.cmd), pending.invocation.id);
+         },
+         info);
+   }
+   scheduleRun();
+}
+
+} // namespace async
+
+#endif // ASYNC_COMMANDTASKS_HPP
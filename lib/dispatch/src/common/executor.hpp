@@ -0,0 +1,56 @@
+#ifndef ASYNC_EXECUTOR_HPP
+#define ASYNC_EXECUTOR_HPP
+
+#include "strand.hpp"
+#include "threadpool.hpp"
+
+#include "utils/coroutine.hpp"
+#include "utils/task.hpp"
+
+#include <type_traits>
+#include <utility>
+
+namespace async {
+
+// cr::Executor for tasks that run on a pool or a strand, e.g. cr::TaskHandle<T, Executor<Strand>>
+template <typename Target>
+struct Executor
+{
+   Target * target = nullptr;
+
+   template <typename F>
+   void Execute(F && f) const
+   {
+      if constexpr (std::is_same_v<Target, Strand>)
+         target->Post(std::forward<F>(f));
+      else
+         target->Submit(std::forward<F>(f));
+   }
+};
+static_assert(cr::Executor<Executor<ThreadPool>>);
+static_assert(cr::Executor<Executor<Strand>>);
+// their tasks run on any of the pool threads, which cr::WhenAll() and cr::WhenAny() cannot handle
+static_assert(!cr::RunsOnOneThread<Executor<ThreadPool>>::value);
+static_assert(!cr::RunsOnOneThread<Executor<Strand>>::value);
+
+// co_await ResumeOn(pool) continues the coroutine on a pool thread, co_await ResumeOn(strand)
+// brings it back
+template <typename Target>
+auto ResumeOn(Target & target)
+{
+   struct Awaiter
+   {
+      Target & target;
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(stdcr::coroutine_handle<> h) const
+      {
+         Executor<Target>{&target}.Execute(h);
+      }
+      void await_resume() const noexcept {}
+   };
+   return Awaiter{target};
+}
+
+} // namespace async
+
+#endif // ASYNC_EXECUTOR_HPP
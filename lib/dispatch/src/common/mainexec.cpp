@@ -8,15 +8,12 @@
 
 #include "utils/log.hpp"
 
-#include <cassert>
 #include <chrono>
 
-using namespace std::chrono_literals;
-
 namespace core {
 namespace {
 
-void ScheduleOnMainWorker(std::function<void()> && task, std::chrono::milliseconds delay = 0ms)
+async::Worker & GetMainWorker()
 {
    static auto onException = [](std::string_view worker, std::string_view exception) {
       Log::Error("MAIN", "Worker {} caught an exception: {}", worker, exception);
@@ -25,39 +22,46 @@ void ScheduleOnMainWorker(std::function<void()> && task, std::chrono::millisecon
       .name = "MAIN_WORKER",
       .capacity = std::numeric_limits<size_t>::max(),
       .exceptionHandler = onException,
+      .collectMetrics = true,
+      .metricsLogInterval = std::chrono::minutes(1),
    });
-   s_worker.Schedule(delay, std::move(task));
+   return s_worker;
 }
 
-IController & GetController()
+Timer::TimerId ScheduleTimerOnMainWorker(Timer::Task && task, std::chrono::milliseconds delay)
 {
-   static auto s_ctrl = core::CreateController(dice::CreateUniformEngine(),
-                                               std::make_unique<core::Timer>(ScheduleOnMainWorker),
-                                               dice::CreateXmlSerializer());
-   return *s_ctrl;
+   return GetMainWorker().ScheduleTimer(delay, std::move(task), {.label = "timer"});
+}
+
+bool CancelTimerOnMainWorker(Timer::TimerId id)
+{
+   return GetMainWorker().CancelTimer(id);
 }
 
 } // namespace
 
-void InternalExec(std::function<void(IController *)> task)
+IController & InternalGetController()
 {
-   ScheduleOnMainWorker([task = std::move(task)] {
-      task(&GetController());
-   });
+   static auto s_ctrl = core::CreateController(
+      dice::CreateUniformEngine(),
+      std::make_unique<core::Timer>(ScheduleTimerOnMainWorker, CancelTimerOnMainWorker),
+      dice::CreateXmlSerializer());
+   return *s_ctrl;
 }
 
-void Scheduler::await_suspend(stdcr::coroutine_handle<> h)
+void InternalExec(UniqueFunction<void()> task)
 {
-   core::Exec([h, this](core::IController * ctrl) mutable {
-      m_ctrl = ctrl;
-      h.resume();
-   });
+   GetMainWorker().Schedule(std::move(task), {.label = "exec"});
+}
+
+void Scheduler::await_suspend(stdcr::coroutine_handle<> h) const
+{
+   GetMainWorker().Schedule(h, {.label = "resume", .priority = priority});
 }
 
 core::IController * Scheduler::await_resume() const noexcept
 {
-   assert(m_ctrl);
-   return m_ctrl;
+   return &InternalGetController();
 }
 
 } // namespace core
@@ -1,30 +1,32 @@
 #ifndef MAIN_EXEC_HPP
 #define MAIN_EXEC_HPP
 
-#include "utils/alwayscopyable.hpp"
-#include "utils/coroutine.hpp"
+#include "worker.hpp"
 
-#include <functional>
+#include "utils/coroutine.hpp"
+#include "utils/uniquefunction.hpp"
 
 namespace core {
 class IController;
 
-void InternalExec(std::function<void(IController *)> task);
+void InternalExec(UniqueFunction<void()> task);
+IController & InternalGetController(); // main worker only
 
 template <typename F>
 void Exec(F && f)
 {
-   InternalExec(AlwaysCopyable(std::move(f)));
+   InternalExec([f = std::forward<F>(f)]() mutable {
+      f(&InternalGetController());
+   });
 }
 
 struct Scheduler
 {
+   async::Priority priority = async::Priority::NORMAL;
+
    bool await_ready() const noexcept { return false; }
-   void await_suspend(stdcr::coroutine_handle<> h);
+   void await_suspend(stdcr::coroutine_handle<> h) const;
    core::IController * await_resume() const noexcept;
-
-private:
-   core::IController * m_ctrl = nullptr;
 };
 
 } // namespace core
@@ -0,0 +1,149 @@
+#ifndef ASYNC_MPSCQUEUE_HPP
+#define ASYNC_MPSCQUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace async {
+
+// Intrusive multi-producer single-consumer queue (D. Vyukov). Push is lock-free, Pop and Empty
+// must only be called by the consumer. Pop may spuriously return nothing while a producer is
+// between its two steps, Empty reports such an item as present. Popped nodes are kept for reuse
+// in a bounded ring, so a queue that has warmed up does not allocate.
+template <typename T>
+class MpscQueue
+{
+public:
+   MpscQueue()
+      : m_head(&m_stub)
+      , m_tail(&m_stub)
+   {
+      for (size_t i = 0; i < FREE_NODES; ++i)
+         m_freeNodes[i].sequence.store(i, std::memory_order_relaxed);
+   }
+   ~MpscQueue()
+   {
+      for (T value; Pop(value);)
+         ;
+      while (Node * node = TakeFreeNode())
+         delete node;
+   }
+   MpscQueue(const MpscQueue &) = delete;
+   MpscQueue & operator=(const MpscQueue &) = delete;
+
+   void Push(T && value)
+   {
+      Node * node = TakeFreeNode();
+      if (node)
+         node->value = std::move(value);
+      else
+         node = new Node(std::move(value));
+      Link(node);
+   }
+
+   bool Pop(T & out)
+   {
+      Hook * tail = m_tail;
+      Hook * next = tail->next.load(std::memory_order_acquire);
+      if (tail == &m_stub) {
+         if (!next)
+            return false;
+         m_tail = next;
+         tail = next;
+         next = next->next.load(std::memory_order_acquire);
+      }
+      if (!next) {
+         if (tail != m_head.load(std::memory_order_acquire))
+            return false; // a producer has not linked its node yet
+         Link(&m_stub);
+         next = tail->next.load(std::memory_order_acquire);
+         if (!next)
+            return false;
+      }
+      m_tail = next;
+      auto * node = static_cast<Node *>(tail);
+      out = std::exchange(node->value, T{});
+      RecycleNode(node);
+      return true;
+   }
+
+   bool Empty() const
+   {
+      return m_tail == &m_stub && !m_stub.next.load(std::memory_order_acquire);
+   }
+
+private:
+   struct Hook
+   {
+      std::atomic<Hook *> next{nullptr};
+   };
+   struct Node : Hook
+   {
+      explicit Node(T && value)
+         : value(std::move(value))
+      {}
+      T value;
+   };
+
+   void Link(Hook * node)
+   {
+      node->next.store(nullptr, std::memory_order_relaxed);
+      Hook * prev = m_head.exchange(node, std::memory_order_acq_rel);
+      prev->next.store(node, std::memory_order_release);
+   }
+
+   // the free node ring is a bounded queue (D. Vyukov) with the consumer as its only producer
+   // and the producers as its consumers
+   static constexpr size_t FREE_NODES = 64;
+   struct FreeSlot
+   {
+      std::atomic<size_t> sequence;
+      Node * node = nullptr;
+   };
+
+   void RecycleNode(Node * node)
+   {
+      FreeSlot & slot = m_freeNodes[m_freeEnqueuePos % FREE_NODES];
+      if (slot.sequence.load(std::memory_order_acquire) != m_freeEnqueuePos) {
+         delete node; // ring is full
+         return;
+      }
+      slot.node = node;
+      slot.sequence.store(++m_freeEnqueuePos, std::memory_order_release);
+   }
+
+   Node * TakeFreeNode()
+   {
+      size_t pos = m_freeDequeuePos.load(std::memory_order_relaxed);
+      for (;;) {
+         FreeSlot & slot = m_freeNodes[pos % FREE_NODES];
+         const auto diff = static_cast<ptrdiff_t>(
+            slot.sequence.load(std::memory_order_acquire) - (pos + 1));
+         if (diff == 0) {
+            if (m_freeDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+               Node * node = slot.node;
+               slot.sequence.store(pos + FREE_NODES, std::memory_order_release);
+               return node;
+            }
+         } else if (diff < 0) {
+            return nullptr; // ring is empty
+         } else {
+            pos = m_freeDequeuePos.load(std::memory_order_relaxed);
+         }
+      }
+   }
+
+   Hook m_stub;
+   std::atomic<Hook *> m_head; // producers' end
+   Hook * m_tail;              // consumer's end
+
+   std::array<FreeSlot, FREE_NODES> m_freeNodes;
+   size_t m_freeEnqueuePos = 0;
+   std::atomic<size_t> m_freeDequeuePos{0};
+};
+
+} // namespace async
+
+#endif // ASYNC_MPSCQUEUE_HPP
@@ -0,0 +1,57 @@
+#include "strand.hpp"
+
+#include <thread>
+#include <utility>
+
+namespace async {
+namespace {
+
+thread_local const Strand * t_currentStrand = nullptr;
+
+} // namespace
+
+Strand::Strand(ThreadPool & pool)
+   : m_pool(pool)
+   , m_pendingCount(0U)
+{}
+
+void Strand::Post(Task && task)
+{
+   m_tasks.Push(std::move(task));
+   // whoever makes the strand non-empty schedules the drain
+   if (m_pendingCount.fetch_add(1U, std::memory_order_acq_rel) == 0)
+      m_pool.Submit([this] {
+         Drain();
+      });
+}
+
+bool Strand::IsCurrent() const noexcept
+{
+   return t_currentStrand == this;
+}
+
+void Strand::Drain()
+{
+   const Strand * outer = std::exchange(t_currentStrand, this);
+   for (size_t done = 0;;) {
+      Task task;
+      // the count is raised after the push, so this only waits for a producer to finish it
+      while (!m_tasks.Pop(task))
+         std::this_thread::yield();
+      m_pool.Invoke(task);
+      task = nullptr;
+
+      if (m_pendingCount.fetch_sub(1U, std::memory_order_acq_rel) == 1)
+         break;
+      if (++done == BATCH_SIZE) {
+         // behind the other work of this thread, a plain Submit() would be popped right away
+         m_pool.Defer([this] {
+            Drain();
+         });
+         break;
+      }
+   }
+   t_currentStrand = outer;
+}
+
+} // namespace async
@@ -0,0 +1,38 @@
+#ifndef ASYNC_STRAND_HPP
+#define ASYNC_STRAND_HPP
+
+#include "mpscqueue.hpp"
+#include "threadpool.hpp"
+
+#include <atomic>
+
+namespace async {
+
+// Runs its tasks one at a time and in posting order on the threads of a pool, so that state
+// touched only from the strand needs no locks. The strand must outlive its tasks.
+class Strand
+{
+public:
+   using Task = ThreadPool::Task;
+
+   explicit Strand(ThreadPool & pool);
+   Strand(const Strand &) = delete;
+   Strand & operator=(const Strand &) = delete;
+
+   void Post(Task && task);
+   // true while one of the strand's tasks runs on the calling thread
+   bool IsCurrent() const noexcept;
+
+private:
+   static constexpr size_t BATCH_SIZE = 64; // then yield the pool thread to other work
+
+   void Drain();
+
+   ThreadPool & m_pool;
+   MpscQueue<Task> m_tasks;
+   std::atomic<size_t> m_pendingCount;
+};
+
+} // namespace async
+
+#endif // ASYNC_STRAND_HPP
@@ -0,0 +1,140 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <exception>
+
+namespace async {
+namespace {
+
+struct CurrentThread
+{
+   const ThreadPool * pool = nullptr;
+   size_t index = 0;
+};
+thread_local CurrentThread t_current;
+
+} // namespace
+
+ThreadPool::ThreadPool(const Config & config)
+   : m_config(config)
+   , m_nextQueue(0U)
+   , m_queuedCount(0U)
+   , m_parkedCount(0U)
+   , m_stopping(false)
+{
+   const size_t count =
+      config.threads ? config.threads : std::max(std::thread::hardware_concurrency(), 1U);
+   for (size_t i = 0; i < count; ++i)
+      m_queues.emplace_back(std::make_unique<Queue>());
+   for (size_t i = 0; i < count; ++i)
+      m_threads.emplace_back([this, i] {
+         Run(i);
+      });
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard lock(m_parkingSync);
+      m_stopping = true;
+   }
+   m_filledSignal.notify_all();
+   for (auto & thread : m_threads)
+      thread.join();
+}
+
+void ThreadPool::Submit(Task && task)
+{
+   Push(std::move(task), false);
+}
+
+void ThreadPool::Defer(Task && task)
+{
+   Push(std::move(task), true);
+}
+
+void ThreadPool::Push(Task && task, bool front)
+{
+   const bool inside = t_current.pool == this;
+   const size_t index =
+      inside ? t_current.index : m_nextQueue.fetch_add(1U, std::memory_order_relaxed) % Size();
+   {
+      Queue & queue = *m_queues[index];
+      std::lock_guard lock(queue.sync);
+      if (inside && front)
+         queue.tasks.push_front(std::move(task));
+      else
+         queue.tasks.push_back(std::move(task));
+   }
+
+   // a thread registers as parked before its last look at the count, so either it sees the
+   // task or we see it parked
+   m_queuedCount.fetch_add(1U, std::memory_order_seq_cst);
+   if (m_parkedCount.load(std::memory_order_seq_cst) == 0)
+      return;
+   {
+      std::lock_guard lock(m_parkingSync);
+   }
+   m_filledSignal.notify_one();
+}
+
+void ThreadPool::Invoke(Task & task) noexcept
+{
+   try {
+      task();
+   }
+   catch (const std::exception & e) {
+      if (m_config.exceptionHandler)
+         m_config.exceptionHandler(m_config.name, e.what());
+   }
+   catch (...) {
+      if (m_config.exceptionHandler)
+         m_config.exceptionHandler(m_config.name, "unknown");
+   }
+}
+
+void ThreadPool::Run(size_t index)
+{
+   t_current = {this, index};
+   for (;;) {
+      if (Task task; TakeTask(index, task)) {
+         m_queuedCount.fetch_sub(1U, std::memory_order_relaxed);
+         Invoke(task);
+         continue;
+      }
+
+      std::unique_lock lock(m_parkingSync);
+      m_parkedCount.fetch_add(1U, std::memory_order_seq_cst);
+      m_filledSignal.wait(lock, [this] {
+         return m_stopping || m_queuedCount.load(std::memory_order_seq_cst) > 0;
+      });
+      m_parkedCount.fetch_sub(1U, std::memory_order_relaxed);
+      if (m_stopping && m_queuedCount.load(std::memory_order_relaxed) == 0)
+         break;
+   }
+}
+
+bool ThreadPool::TakeTask(size_t index, Task & out)
+{
+   {
+      Queue & own = *m_queues[index];
+      std::lock_guard lock(own.sync);
+      if (!own.tasks.empty()) {
+         out = std::move(own.tasks.back());
+         own.tasks.pop_back();
+         return true;
+      }
+   }
+   for (size_t i = 1; i < Size(); ++i) {
+      Queue & victim = *m_queues[(index + i) % Size()];
+      std::lock_guard lock(victim.sync);
+      if (!victim.tasks.empty()) {
+         out = std::move(victim.tasks.front());
+         victim.tasks.pop_front();
+         return true;
+      }
+   }
+   return false;
+}
+
+} // namespace async
@@ -0,0 +1,72 @@
+#ifndef ASYNC_THREADPOOL_HPP
+#define ASYNC_THREADPOOL_HPP
+
+#include "utils/uniquefunction.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace async {
+
+// Work-stealing pool for CPU-heavy tasks that may run in parallel. Every thread has its own
+// queue: tasks submitted from a pool thread go to the back of its queue and are taken from
+// there (LIFO, cache friendly), idle threads steal from the front of the others' queues.
+// Tasks submitted from outside are spread across the queues round-robin.
+class ThreadPool
+{
+public:
+   struct Config
+   {
+      std::string name;
+      size_t threads = 0; // 0 means one per core
+      std::function<void(std::string_view /*pool*/, std::string_view /*ex*/)> exceptionHandler;
+   };
+   using Task = UniqueFunction<void()>;
+
+   explicit ThreadPool(const Config & config);
+   ~ThreadPool(); // runs all submitted tasks first
+
+   void Submit(Task && task);
+   // like Submit(), but from a pool thread the task goes to the front of its queue, so that it
+   // runs after the tasks already there unless another thread steals it first
+   void Defer(Task && task);
+   size_t Size() const noexcept { return m_threads.size(); }
+
+   // runs the task on the calling thread, exceptions go to Config::exceptionHandler
+   void Invoke(Task & task) noexcept;
+
+private:
+   struct Queue
+   {
+      std::mutex sync;
+      std::deque<Task> tasks;
+   };
+
+   void Push(Task && task, bool front);
+   void Run(size_t index);
+   bool TakeTask(size_t index, Task & out);
+
+   const Config m_config;
+   std::vector<std::unique_ptr<Queue>> m_queues;
+   std::atomic<size_t> m_nextQueue;
+
+   std::mutex m_parkingSync;
+   std::condition_variable m_filledSignal;
+   std::atomic<size_t> m_queuedCount; // never less than the number of queued tasks
+   std::atomic<size_t> m_parkedCount;
+   bool m_stopping;
+
+   std::vector<std::thread> m_threads;
+};
+
+} // namespace async
+
+#endif // ASYNC_THREADPOOL_HPP
@@ -0,0 +1,229 @@
+#ifndef ASYNC_TIMINGWHEEL_HPP
+#define ASYNC_TIMINGWHEEL_HPP
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace async {
+
+// Hierarchical timing wheel with 64 slots per level, time is measured in abstract ticks. An entry
+// sits in the lowest level whose current slot range also holds its deadline, and moves down when
+// the wheel reaches the start of its slot. Entries due at the same tick expire in insertion order.
+// Not thread-safe.
+template <typename T>
+class TimingWheel
+{
+   static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+public:
+   static constexpr uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+   struct Handle
+   {
+      uint32_t index = NONE;
+      uint32_t generation = 0;
+   };
+
+   explicit TimingWheel(uint64_t now = 0)
+      : m_now(now)
+   {}
+
+   uint64_t Now() const noexcept { return m_now; }
+   size_t Size() const noexcept { return m_size; }
+
+   Handle Insert(uint64_t deadline, T && value)
+   {
+      const uint32_t index = Allocate();
+      Node & node = m_nodes[index];
+      node.value = std::move(value);
+      node.deadline = deadline;
+      Place(index);
+      ++m_size;
+      return {index, node.generation};
+   }
+
+   // false if the entry has already expired or been cancelled
+   bool Cancel(Handle handle)
+   {
+      if (handle.index >= m_nodes.size())
+         return false;
+      Node & node = m_nodes[handle.index];
+      if (node.generation != handle.generation || node.list == FREE_LIST)
+         return false;
+      Unlink(handle.index);
+      Release(handle.index);
+      --m_size;
+      return true;
+   }
+
+   // earliest tick at which Advance() has work to do, NEVER if the wheel is empty
+   uint64_t NextEventTick() const noexcept
+   {
+      return m_lists[EXPIRED_LIST].head != NONE ? m_now : NextTick();
+   }
+
+   // moves everything due by the given tick to the expired list
+   void Advance(uint64_t now)
+   {
+      while (m_now < now) {
+         const uint64_t next = NextTick();
+         if (next > now) {
+            m_now = now;
+            break;
+         }
+         m_now = next;
+         // higher levels first, so that their entries can move further down in the same tick
+         if ((m_now & (RANGE - 1U)) == 0)
+            Cascade(OVERFLOW_LIST);
+         for (size_t level = LEVELS - 1U; level > 0; --level) {
+            const size_t shift = SLOT_BITS * level;
+            if ((m_now & ((uint64_t(1) << shift) - 1U)) == 0)
+               Cascade(level * SLOTS + ((m_now >> shift) & (SLOTS - 1U)));
+         }
+         Cascade(m_now & (SLOTS - 1U));
+      }
+   }
+
+   bool PopExpired(T & out)
+   {
+      const uint32_t index = m_lists[EXPIRED_LIST].head;
+      if (index == NONE)
+         return false;
+      Unlink(index);
+      out = std::move(m_nodes[index].value);
+      Release(index);
+      --m_size;
+      return true;
+   }
+
+private:
+   static constexpr size_t SLOT_BITS = 6U;
+   static constexpr size_t SLOTS = size_t(1) << SLOT_BITS;
+   static constexpr size_t LEVELS = 4U;
+   static constexpr uint64_t RANGE = uint64_t(1) << (SLOT_BITS * LEVELS);
+   static constexpr size_t EXPIRED_LIST = LEVELS * SLOTS;
+   static constexpr size_t OVERFLOW_LIST = EXPIRED_LIST + 1U;
+   static constexpr size_t FREE_LIST = OVERFLOW_LIST + 1U;
+
+   struct Node
+   {
+      T value;
+      uint64_t deadline = 0;
+      uint32_t prev = NONE;
+      uint32_t next = NONE;
+      uint32_t generation = 0;
+      uint32_t list = FREE_LIST;
+   };
+   struct List
+   {
+      uint32_t head = NONE;
+      uint32_t tail = NONE;
+   };
+
+   uint64_t NextTick() const noexcept
+   {
+      // entries of a lower level always fire before the next slot of a higher level starts
+      for (size_t level = 0; level < LEVELS; ++level) {
+         const size_t shift = SLOT_BITS * level;
+         const auto current = static_cast<size_t>(m_now >> shift) & (SLOTS - 1U);
+         const uint64_t later = m_occupied[level] & ~((uint64_t(2) << current) - 1U);
+         if (later) {
+            const uint64_t block = (m_now >> (shift + SLOT_BITS)) << (shift + SLOT_BITS);
+            return block | (uint64_t(std::countr_zero(later)) << shift);
+         }
+      }
+      if (m_lists[OVERFLOW_LIST].head != NONE)
+         return (m_now / RANGE + 1U) * RANGE;
+      return NEVER;
+   }
+
+   void Place(uint32_t index)
+   {
+      const uint64_t deadline = m_nodes[index].deadline;
+      if (deadline <= m_now) {
+         Append(EXPIRED_LIST, index);
+         return;
+      }
+      for (size_t level = 0; level < LEVELS; ++level) {
+         const size_t shift = SLOT_BITS * (level + 1U);
+         if ((deadline >> shift) == (m_now >> shift)) {
+            const auto slot = static_cast<size_t>(deadline >> (shift - SLOT_BITS)) & (SLOTS - 1U);
+            Append(level * SLOTS + slot, index);
+            return;
+         }
+      }
+      Append(OVERFLOW_LIST, index);
+   }
+
+   void Cascade(size_t list)
+   {
+      uint32_t index = std::exchange(m_lists[list], {}).head;
+      if (list < EXPIRED_LIST)
+         m_occupied[list / SLOTS] &= ~(uint64_t(1) << (list % SLOTS));
+      while (index != NONE) {
+         const uint32_t next = m_nodes[index].next;
+         Place(index);
+         index = next;
+      }
+   }
+
+   void Append(size_t list, uint32_t index)
+   {
+      Node & node = m_nodes[index];
+      List & l = m_lists[list];
+      node.list = static_cast<uint32_t>(list);
+      node.prev = l.tail;
+      node.next = NONE;
+      if (l.tail != NONE)
+         m_nodes[l.tail].next = index;
+      else
+         l.head = index;
+      l.tail = index;
+      if (list < EXPIRED_LIST)
+         m_occupied[list / SLOTS] |= uint64_t(1) << (list % SLOTS);
+   }
+
+   void Unlink(uint32_t index)
+   {
+      Node & node = m_nodes[index];
+      List & l = m_lists[node.list];
+      (node.prev != NONE ? m_nodes[node.prev].next : l.head) = node.next;
+      (node.next != NONE ? m_nodes[node.next].prev : l.tail) = node.prev;
+      if (node.list < EXPIRED_LIST && l.head == NONE)
+         m_occupied[node.list / SLOTS] &= ~(uint64_t(1) << (node.list % SLOTS));
+   }
+
+   uint32_t Allocate()
+   {
+      if (m_free == NONE) {
+         m_nodes.emplace_back();
+         return static_cast<uint32_t>(m_nodes.size() - 1U);
+      }
+      return std::exchange(m_free, m_nodes[m_free].next);
+   }
+
+   void Release(uint32_t index)
+   {
+      Node & node = m_nodes[index];
+      node.value = T();
+      node.list = FREE_LIST;
+      ++node.generation;
+      node.next = std::exchange(m_free, index);
+   }
+
+   uint64_t m_now;
+   size_t m_size = 0;
+   std::vector<Node> m_nodes;
+   uint32_t m_free = NONE;
+   std::array<List, OVERFLOW_LIST + 1U> m_lists;
+   std::array<uint64_t, LEVELS> m_occupied{};
+};
+
+} // namespace async
+
+#endif // ASYNC_TIMINGWHEEL_HPP
@@ -1,94 +1,451 @@
 #include "worker.hpp"
 
+#include "utils/log.hpp"
+
+#include <algorithm>
+#include <cstring>
+
 namespace async {
+namespace {
+
+constexpr auto TAG = "Worker";
+
+uint64_t ToMicroseconds(std::chrono::steady_clock::duration d)
+{
+   const auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+   return us > 0 ? static_cast<uint64_t>(us) : 0U;
+}
+
+bool IsSheddable(const Worker::LaneConfig & config)
+{
+   return config.overflow == Worker::Overflow::DROP_OLDEST || config.coalesce;
+}
+
+} // namespace
 
 using namespace std::chrono_literals;
 
 Worker::Worker(const async::Worker::Config & config)
    : m_config(config)
-   , m_stop(false)
+   , m_stopping(false)
+   , m_epoch(std::chrono::steady_clock::now())
+   , m_parked(false)
+   , m_taskCount(0U)
+   , m_blockedProducers(0U)
+   , m_batchBacklog(0U)
+   , m_peakTaskCount(0U)
    , m_thread([this] {
       Run();
    })
-{}
+{
+   if (m_config.collectMetrics && m_config.metricsLogInterval > 0ms)
+      ScheduleMetricsDump();
+}
 
 Worker::~Worker()
 {
-   Schedule([this] {
-      m_stop = true;
-   });
+   // the worker stops once it runs out of immediate tasks
+   m_stopping.store(true, std::memory_order_relaxed);
+   WakeUp();
    m_thread.join();
 }
 
-void Worker::Schedule(Task && work)
+void Worker::Schedule(Task && work, const TaskInfo & info)
 {
-   Schedule(0ms, std::move(work));
+   Schedule(0ms, std::move(work), info);
 }
 
-bool Worker::TrySchedule(Task && work)
+bool Worker::TrySchedule(Task && work, const TaskInfo & info)
 {
-   return TrySchedule(0ms, std::move(work));
+   return TrySchedule(0ms, std::move(work), info);
 }
 
-void Worker::Schedule(std::chrono::milliseconds delay, Task && work)
+void Worker::Schedule(std::chrono::milliseconds delay, Task && work, const TaskInfo & info)
 {
-   auto timeToFire = std::chrono::steady_clock::now() + delay;
-   {
-      std::unique_lock lock(m_tasksSync);
-      m_emptiedSignal.wait(lock, [this] {
-         return m_tasks.size() < m_config.capacity;
-      });
-      m_tasks.emplace(timeToFire, std::move(work));
+   Reserve();
+   Enqueue(delay, std::move(work), info, true);
+}
+
+bool Worker::TrySchedule(std::chrono::milliseconds delay, Task && work, const TaskInfo & info)
+{
+   if (!TryReserve())
+      return false;
+   return Enqueue(delay, std::move(work), info, false);
+}
+
+Worker::TimerId Worker::ScheduleTimer(std::chrono::milliseconds delay,
+                                      Task && work,
+                                      const TaskInfo & info)
+{
+   if (delay <= 0ms || std::this_thread::get_id() != m_thread.get_id()) {
+      Schedule(delay, std::move(work), info);
+      return NO_TIMER;
    }
-   m_filledSignal.notify_one();
+   Reserve();
+   // keep tasks scheduled earlier with the same deadline ahead of this one
+   TakeIncomingDelayedTasks();
+   const auto deadline = std::chrono::steady_clock::now() + delay;
+   const auto handle =
+      m_delayedTasks.Insert(ToTick(deadline, true), {std::move(work), deadline, info.label});
+   return (TimerId(handle.index) + 1U) << 32U | handle.generation;
 }
 
-bool Worker::TrySchedule(std::chrono::milliseconds delay, Task && work)
+bool Worker::CancelTimer(TimerId id)
 {
-   auto timeToFire = std::chrono::steady_clock::now() + delay;
-   {
-      std::unique_lock lock(m_tasksSync);
-      if (m_tasks.size() >= m_config.capacity)
+   if (id == NO_TIMER || std::this_thread::get_id() != m_thread.get_id())
+      return false;
+   const TimingWheel<QueuedTask>::Handle handle{
+      .index = static_cast<uint32_t>((id >> 32U) - 1U),
+      .generation = static_cast<uint32_t>(id),
+   };
+   if (!m_delayedTasks.Cancel(handle))
+      return false;
+   Release(1U);
+   return true;
+}
+
+bool Worker::TryReserve()
+{
+   size_t count = m_taskCount.load(std::memory_order_relaxed);
+   do {
+      if (count >= m_config.capacity)
          return false;
-      m_tasks.emplace(timeToFire, std::move(work));
+   } while (!m_taskCount.compare_exchange_weak(count, count + 1, std::memory_order_relaxed));
+
+   if (m_config.collectMetrics) {
+      const size_t depth = count + 1 + m_batchBacklog.load(std::memory_order_relaxed);
+      size_t peak = m_peakTaskCount.load(std::memory_order_relaxed);
+      while (depth > peak &&
+             !m_peakTaskCount.compare_exchange_weak(peak, depth, std::memory_order_relaxed))
+         ;
    }
-   m_filledSignal.notify_one();
    return true;
 }
 
-void Worker::Run()
+void Worker::Reserve()
+{
+   if (TryReserve())
+      return;
+   std::unique_lock lock(m_parkingSync);
+   m_blockedProducers.fetch_add(1U, std::memory_order_relaxed);
+   // pairs with the fence in Release(), either we see the room or it sees us
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   m_spaceSignal.wait(lock, [this] {
+      return TryReserve();
+   });
+   m_blockedProducers.fetch_sub(1U, std::memory_order_relaxed);
+}
+
+bool Worker::Enqueue(std::chrono::milliseconds delay,
+                     Task && work,
+                     const TaskInfo & info,
+                     bool wait)
+{
+   if (delay > 0ms) {
+      m_incomingDelayedTasks.Push(
+         {std::move(work), std::chrono::steady_clock::now() + delay, info.label});
+   } else {
+      QueuedTask queued{std::move(work), {}, info.label, info.coalesceKey};
+      if (m_config.collectMetrics)
+         queued.ready = std::chrono::steady_clock::now();
+      if (!PushToLane(std::move(queued), info.priority, wait)) {
+         Release(1U);
+         return false;
+      }
+   }
+   WakeUp();
+   return true;
+}
+
+bool Worker::PushToLane(QueuedTask && queued, Priority priority, bool wait)
 {
-   Task work;
+   const auto index = static_cast<size_t>(priority);
+   Lane & lane = m_lanes[index];
+   const LaneConfig & config = m_config.lanes[index];
+   const bool sheddable = IsSheddable(config);
 
-   while (!m_stop) {
-      GetNextTask(work);
-      m_emptiedSignal.notify_one();
-      try {
-         work();
+   QueuedTask dropped; // destroyed outside of the lock
+   for (;;) {
+      std::unique_lock lock(lane.sync, std::defer_lock);
+      if (sheddable) {
+         lock.lock();
+         auto & tasks = lane.sheddableTasks;
+         auto victim = std::end(tasks);
+         if (config.coalesce && queued.coalesceKey != 0) {
+            victim = std::find_if(std::begin(tasks), std::end(tasks), [&](const QueuedTask & t) {
+               return t.coalesceKey == queued.coalesceKey;
+            });
+         }
+         if (victim == std::end(tasks) && config.overflow == Overflow::DROP_OLDEST &&
+             lane.count.load(std::memory_order_relaxed) >= config.capacity)
+            victim = std::begin(tasks);
+         if (victim != std::end(tasks)) {
+            dropped = std::move(*victim);
+            tasks.erase(victim);
+            tasks.push_back(std::move(queued));
+            break;
+         }
       }
-      catch (const std::exception & e) {
-         m_config.exceptionHandler(m_config.name, e.what());
+
+      size_t count = lane.count.load(std::memory_order_relaxed);
+      while (count < config.capacity &&
+             !lane.count.compare_exchange_weak(count, count + 1, std::memory_order_relaxed))
+         ;
+      if (count < config.capacity) {
+         if (sheddable)
+            lane.sheddableTasks.push_back(std::move(queued));
+         else
+            lane.tasks.Push(std::move(queued));
+         return true;
       }
-      catch (...) {
-         m_config.exceptionHandler(m_config.name, "unknown");
+      if (config.overflow != Overflow::BLOCK || !wait) {
+         if (config.overflow != Overflow::BLOCK)
+            lane.shed.fetch_add(1U, std::memory_order_relaxed);
+         return false;
       }
+      if (!lock.owns_lock())
+         lock.lock();
+      lane.blockedProducers.fetch_add(1U, std::memory_order_relaxed);
+      // pairs with the fence in TakeFromLane(), either we see the room or it sees us
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      lane.spaceSignal.wait(lock, [&] {
+         return lane.count.load(std::memory_order_relaxed) < config.capacity;
+      });
+      lane.blockedProducers.fetch_sub(1U, std::memory_order_relaxed);
    }
+   // the new task took the place of the dropped one
+   lane.shed.fetch_add(1U, std::memory_order_relaxed);
+   Release(1U);
+   return true;
 }
 
-void Worker::GetNextTask(Task & out)
+void Worker::WakeUp()
+{
+   // the worker raises the flag before its last emptiness check, so either it sees the task
+   // or we see the flag
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if (!m_parked.load(std::memory_order_relaxed))
+      return;
+   {
+      std::lock_guard lock(m_parkingSync);
+   }
+   m_filledSignal.notify_one();
+}
+
+void Worker::Run()
 {
-   std::unique_lock lock(m_tasksSync);
-   m_filledSignal.wait(lock, [this] {
-      return !m_tasks.empty();
+   std::vector<QueuedTask> batch;
+   batch.reserve(std::max<size_t>(m_config.batchSize, 1U));
+
+   while (GetNextTasks(batch)) {
+      if (m_config.collectMetrics)
+         m_batchBacklog.store(batch.size(), std::memory_order_relaxed);
+      Release(batch.size());
+      for (auto & task : batch)
+         RunTask(task);
+      batch.clear();
+   }
+}
+
+void Worker::RunTask(QueuedTask & queued)
+{
+   std::chrono::steady_clock::time_point start;
+   if (m_config.collectMetrics) {
+      m_batchBacklog.fetch_sub(1U, std::memory_order_relaxed);
+      start = std::chrono::steady_clock::now();
+      m_waitTime.Record(ToMicroseconds(start - queued.ready));
+   }
+   try {
+      queued.task();
+   }
+   catch (const std::exception & e) {
+      m_config.exceptionHandler(m_config.name, e.what());
+   }
+   catch (...) {
+      m_config.exceptionHandler(m_config.name, "unknown");
+   }
+   if (m_config.collectMetrics) {
+      const uint64_t runTime = ToMicroseconds(std::chrono::steady_clock::now() - start);
+      m_runTime.Record(runTime);
+      if (LabelMetrics * labelMetrics = GetLabelMetrics(queued.label))
+         labelMetrics->runTime.Record(runTime);
+   }
+}
+
+bool Worker::GetNextTasks(std::vector<QueuedTask> & out)
+{
+   const size_t limit = std::max<size_t>(m_config.batchSize, 1U);
+   for (;;) {
+      TakeIncomingDelayedTasks();
+
+      // due delayed tasks go first, so that a stream of immediate ones cannot starve them
+      if (m_delayedTasks.NextEventTick() != m_delayedTasks.NEVER) {
+         const uint64_t now = ToTick(std::chrono::steady_clock::now(), false);
+         if (m_delayedTasks.NextEventTick() <= now)
+            m_delayedTasks.Advance(now);
+         for (QueuedTask task; out.size() < limit && m_delayedTasks.PopExpired(task);)
+            out.push_back(std::move(task));
+      }
+      for (size_t lane = 0; lane < PRIORITY_COUNT && out.size() < limit; ++lane)
+         TakeFromLane(lane, limit, out);
+      if (!out.empty())
+         return true;
+      if (m_stopping.load(std::memory_order_relaxed))
+         return false;
+
+      std::unique_lock lock(m_parkingSync);
+      m_parked.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      // a lane count may be ahead of its queue for a moment, then we just go round once more
+      auto wakeUp = [this] {
+         return m_stopping.load(std::memory_order_relaxed) ||
+                !m_incomingDelayedTasks.Empty() ||
+                std::any_of(std::begin(m_lanes), std::end(m_lanes), [](const Lane & lane) {
+                   return lane.count.load(std::memory_order_relaxed) > 0;
+                });
+      };
+      const uint64_t next = m_delayedTasks.NextEventTick();
+      if (next == m_delayedTasks.NEVER)
+         m_filledSignal.wait(lock, wakeUp);
+      else
+         m_filledSignal.wait_until(lock, m_epoch + std::chrono::milliseconds(next), wakeUp);
+      m_parked.store(false, std::memory_order_relaxed);
+   }
+}
+
+void Worker::TakeFromLane(size_t index, size_t limit, std::vector<QueuedTask> & out)
+{
+   Lane & lane = m_lanes[index];
+   const LaneConfig & config = m_config.lanes[index];
+   const size_t before = out.size();
+   if (IsSheddable(config)) {
+      if (lane.count.load(std::memory_order_relaxed) == 0)
+         return;
+      std::lock_guard lock(lane.sync);
+      for (auto & tasks = lane.sheddableTasks; out.size() < limit && !tasks.empty();
+           tasks.pop_front())
+         out.push_back(std::move(tasks.front()));
+      lane.count.fetch_sub(out.size() - before, std::memory_order_relaxed);
+   } else {
+      for (QueuedTask task; out.size() < limit && lane.tasks.Pop(task);)
+         out.push_back(std::move(task));
+      if (out.size() == before)
+         return;
+      lane.count.fetch_sub(out.size() - before, std::memory_order_relaxed);
+   }
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if (lane.blockedProducers.load(std::memory_order_relaxed) == 0)
+      return;
+   {
+      std::lock_guard lock(lane.sync);
+   }
+   lane.spaceSignal.notify_all();
+}
+
+void Worker::TakeIncomingDelayedTasks()
+{
+   for (QueuedTask delayed; m_incomingDelayedTasks.Pop(delayed);)
+      m_delayedTasks.Insert(ToTick(delayed.ready, true), std::move(delayed));
+}
+
+void Worker::Release(size_t count)
+{
+   m_taskCount.fetch_sub(count, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if (m_blockedProducers.load(std::memory_order_relaxed) == 0)
+      return;
+   {
+      std::lock_guard lock(m_parkingSync);
+   }
+   m_spaceSignal.notify_all();
+}
+
+uint64_t Worker::ToTick(std::chrono::steady_clock::time_point time, bool roundUp) const
+{
+   // deadlines round up and the clock rounds down, so that nothing fires early
+   const auto sinceEpoch = std::max(time - m_epoch, std::chrono::steady_clock::duration::zero());
+   const auto ticks = roundUp ? std::chrono::ceil<std::chrono::milliseconds>(sinceEpoch)
+                              : std::chrono::floor<std::chrono::milliseconds>(sinceEpoch);
+   return static_cast<uint64_t>(ticks.count());
+}
+
+Worker::Metrics Worker::GetMetrics() const
+{
+   Metrics metrics;
+   for (size_t lane = 0; lane < PRIORITY_COUNT; ++lane)
+      metrics.shed[lane] = m_lanes[lane].shed.load(std::memory_order_relaxed);
+   if (!m_config.collectMetrics)
+      return metrics;
+   metrics.depth = m_taskCount.load(std::memory_order_relaxed) +
+                   m_batchBacklog.load(std::memory_order_relaxed);
+   metrics.peakDepth = m_peakTaskCount.load(std::memory_order_relaxed);
+   metrics.waitTime = m_waitTime.GetSnapshot();
+   metrics.runTime = m_runTime.GetSnapshot();
+   for (const auto & labelMetrics : m_labelMetrics) {
+      const char * label = labelMetrics.label.load(std::memory_order_acquire);
+      if (!label)
+         break;
+      metrics.runTimeByLabel.emplace_back(label, labelMetrics.runTime.GetSnapshot());
+   }
+   return metrics;
+}
+
+void Worker::LogMetrics() const
+{
+   if (!m_config.collectMetrics)
+      return;
+   const Metrics metrics = GetMetrics();
+   Log::Debug(TAG,
+              "{}: depth={} peak={} wait p50={}us p99={}us max={}us run p50={}us p99={}us "
+              "max={}us shed={}/{}/{}/{}",
+              m_config.name,
+              metrics.depth,
+              metrics.peakDepth,
+              metrics.waitTime.Percentile(50),
+              metrics.waitTime.Percentile(99),
+              metrics.waitTime.max,
+              metrics.runTime.Percentile(50),
+              metrics.runTime.Percentile(99),
+              metrics.runTime.max,
+              metrics.shed[0],
+              metrics.shed[1],
+              metrics.shed[2],
+              metrics.shed[3]);
+   for (const auto & [label, runTime] : metrics.runTimeByLabel) {
+      Log::Debug(TAG,
+                 "{} {}: count={} run p50={}us p99={}us max={}us",
+                 m_config.name,
+                 label,
+                 runTime.count,
+                 runTime.Percentile(50),
+                 runTime.Percentile(99),
+                 runTime.max);
+   }
+}
+
+void Worker::ScheduleMetricsDump()
+{
+   Schedule(m_config.metricsLogInterval, [this] {
+      LogMetrics();
+      ScheduleMetricsDump();
    });
-   for (auto nextTimerTime = std::begin(m_tasks)->first;
-        nextTimerTime > std::chrono::steady_clock::now();
-        nextTimerTime = std::begin(m_tasks)->first) {
-      m_filledSignal.wait_until(lock, nextTimerTime);
-   }
-   auto it = std::begin(m_tasks);
-   out = std::move(it->second);
-   m_tasks.erase(it);
+}
+
+Worker::LabelMetrics * Worker::GetLabelMetrics(const char * label)
+{
+   if (!label)
+      return nullptr;
+   // only the worker thread adds labels, readers stop at the first empty slot
+   for (auto & labelMetrics : m_labelMetrics) {
+      const char * existing = labelMetrics.label.load(std::memory_order_relaxed);
+      if (!existing) {
+         labelMetrics.label.store(label, std::memory_order_release);
+         return &labelMetrics;
+      }
+      if (existing == label || std::strcmp(existing, label) == 0)
+         return &labelMetrics;
+   }
+   return nullptr; // too many labels, only counted in the totals
 }
 
 } // namespace async
@@ -1,46 +1,169 @@
 #ifndef ASYNC_WORKER_HPP
 #define ASYNC_WORKER_HPP
 
+#include "mpscqueue.hpp"
+#include "timingwheel.hpp"
+
+#include "utils/histogram.hpp"
+#include "utils/uniquefunction.hpp"
+
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
-#include <map>
+#include <limits>
 #include <mutex>
+#include <string>
 #include <string_view>
 #include <thread>
+#include <vector>
 
 namespace async {
 
+// immediate tasks of a higher priority always run before those of a lower one
+enum class Priority : uint8_t {
+   CRITICAL, // e.g. command responses
+   HIGH,     // e.g. socket events
+   NORMAL,
+   LOW, // e.g. UI notifications, deferred work
+};
+constexpr size_t PRIORITY_COUNT = 4;
+
+struct TaskInfo
+{
+   const char * label = nullptr; // must outlive the worker, string literals are the intended use
+   Priority priority = Priority::NORMAL;
+   uint32_t coalesceKey = 0; // see LaneConfig::coalesce, 0 is never coalesced
+};
+
 class Worker
 {
 public:
+   // what Schedule() does when the lane of the task is full, TrySchedule() fails unless the
+   // policy makes room
+   enum class Overflow : uint8_t {
+      BLOCK,       // wait until the worker takes a task from the lane
+      REJECT,      // drop the new task
+      DROP_OLDEST, // drop the task that has waited the longest in the lane
+   };
+   struct LaneConfig
+   {
+      size_t capacity = std::numeric_limits<size_t>::max();
+      Overflow overflow = Overflow::BLOCK;
+      bool coalesce = false; // a new task replaces a queued one with the same coalesceKey
+   };
+
    struct Config
    {
       std::string name;
       size_t capacity;
       std::function<void(std::string_view /*worker*/, std::string_view /*ex*/)> exceptionHandler;
+      size_t batchSize = 64; // max tasks taken from the queues at once
+      bool collectMetrics = false;
+      std::chrono::milliseconds metricsLogInterval{0}; // 0 disables the periodic dump
+      std::array<LaneConfig, PRIORITY_COUNT> lanes{};    // indexed by Priority
+   };
+   using Task = UniqueFunction<void()>;
+
+   // all times in microseconds, wait time is counted from scheduling or from the deadline
+   struct Metrics
+   {
+      using Histogram = stats::Histogram<>;
+      size_t depth = 0;
+      size_t peakDepth = 0;
+      Histogram::Snapshot waitTime;
+      Histogram::Snapshot runTime;
+      std::vector<std::pair<std::string_view, Histogram::Snapshot>> runTimeByLabel;
+      std::array<size_t, PRIORITY_COUNT> shed{}; // dropped and coalesced tasks per lane
    };
-   using Task = std::function<void()>;
 
    Worker(const Config & config);
    ~Worker();
 
-   void Schedule(Task && work);
-   bool TrySchedule(Task && work);
-   void Schedule(std::chrono::milliseconds delay, Task && work);
-   bool TrySchedule(std::chrono::milliseconds delay, Task && work);
+   // delayed tasks skip the lanes and run ahead of all immediate ones once they are due
+   void Schedule(Task && work, const TaskInfo & info = {});
+   bool TrySchedule(Task && work, const TaskInfo & info = {});
+   void Schedule(std::chrono::milliseconds delay, Task && work, const TaskInfo & info = {});
+   bool TrySchedule(std::chrono::milliseconds delay, Task && work, const TaskInfo & info = {});
+
+   // like Schedule() but returns an id for CancelTimer(), or NO_TIMER if the task can't be
+   // cancelled because it has no delay or the caller is not on the worker thread
+   using TimerId = uint64_t;
+   static constexpr TimerId NO_TIMER = 0;
+   TimerId ScheduleTimer(std::chrono::milliseconds delay,
+                         Task && work,
+                         const TaskInfo & info = {});
+   // worker thread only, false if the task has already run or been cancelled
+   bool CancelTimer(TimerId id);
+
+   // shed counts are always kept, everything else is empty unless Config::collectMetrics is set
+   Metrics GetMetrics() const;
+   void LogMetrics() const;
 
 private:
+   struct QueuedTask
+   {
+      Task task;
+      std::chrono::steady_clock::time_point ready; // deadline, or scheduling time with metrics
+      const char * label = nullptr;
+      uint32_t coalesceKey = 0;
+   };
+   // lanes that never shed or coalesce are lock-free, the others keep their tasks under a lock
+   struct Lane
+   {
+      std::atomic<size_t> count{0}; // queued tasks, the worker may not see all of them yet
+      std::atomic<size_t> shed{0};
+      std::atomic<size_t> blockedProducers{0};
+      MpscQueue<QueuedTask> tasks;
+      std::mutex sync;
+      std::condition_variable spaceSignal;
+      std::deque<QueuedTask> sheddableTasks;
+   };
+   struct LabelMetrics
+   {
+      std::atomic<const char *> label{nullptr};
+      Metrics::Histogram runTime;
+   };
+   static constexpr size_t MAX_LABELS = 16;
+
    void Run();
-   void GetNextTask(Task & out);
+   void RunTask(QueuedTask & queued);
+   bool GetNextTasks(std::vector<QueuedTask> & out);
+   void TakeIncomingDelayedTasks();
+   void Release(size_t count);
+   uint64_t ToTick(std::chrono::steady_clock::time_point time, bool roundUp) const;
+   bool TryReserve();
+   void Reserve();
+   bool Enqueue(std::chrono::milliseconds delay, Task && work, const TaskInfo & info, bool wait);
+   bool PushToLane(QueuedTask && queued, Priority priority, bool wait);
+   void TakeFromLane(size_t index, size_t limit, std::vector<QueuedTask> & out);
+   void WakeUp();
+   void ScheduleMetricsDump();
+   LabelMetrics * GetLabelMetrics(const char * label);
 
    const Config m_config;
-   bool m_stop;
+   std::atomic_bool m_stopping;
+   const std::chrono::steady_clock::time_point m_epoch;
+
+   // producers never lock, delayed tasks are moved to the wheel by the worker thread
+   std::array<Lane, PRIORITY_COUNT> m_lanes;
+   MpscQueue<QueuedTask> m_incomingDelayedTasks;
+   TimingWheel<QueuedTask> m_delayedTasks; // millisecond ticks since m_epoch
 
-   std::multimap<std::chrono::steady_clock::time_point, Task> m_tasks;
-   std::mutex m_tasksSync;
+   std::mutex m_parkingSync;
    std::condition_variable m_filledSignal;
-   std::condition_variable m_emptiedSignal;
+   std::atomic_bool m_parked;
+   std::atomic<size_t> m_taskCount;
+   std::condition_variable m_spaceSignal; // for producers blocked on capacity
+   std::atomic<size_t> m_blockedProducers;
+
+   std::atomic<size_t> m_batchBacklog; // taken off the queues but not started yet
+   std::atomic<size_t> m_peakTaskCount;
+   Metrics::Histogram m_waitTime;
+   Metrics::Histogram m_runTime;
+   std::array<LabelMetrics, MAX_LABELS> m_labelMetrics;
 
    std::thread m_thread;
 };
@@ -0,0 +1,24 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// kept out of the test sources so that the replacement can't be inlined and paired with free()
+std::atomic_size_t g_allocations = 0;
+
+void * operator new(size_t size)
+{
+   g_allocations.fetch_add(1, std::memory_order_relaxed);
+   if (void * p = std::malloc(size))
+      return p;
+   throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+   std::free(p);
+}
@@ -1,13 +1,24 @@
 #include <gtest/gtest.h>
 
+#include "../src/common/commandtasks.hpp"
+#include "../src/common/timingwheel.hpp"
 #include "../src/common/worker.hpp"
 
+#include "utils/coroutine.hpp"
+
 #include <atomic>
 #include <future>
 #include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+// counted by the replacement operator new in allocationcounter.cpp
+extern std::atomic_size_t g_allocations;
 
 namespace {
 using namespace std::chrono_literals;
+using async::TimingWheel;
 using async::Worker;
 
 TEST(WorkerTest, worker_executes_instantaneous_task_within_100ms)
@@ -124,4 +135,425 @@ TEST(WorkerTest, worker_handles_uncaught_exceptions)
    EXPECT_STREQ("test exception", exceptionWhat.c_str());
 }
 
+TEST(WorkerTest, worker_drops_cancelled_timers)
+{
+   auto w = CreateReadyWorker(1);
+
+   std::atomic_bool fired = false;
+   std::promise<bool> cancelled;
+   auto future = cancelled.get_future();
+   w->Schedule([&] {
+      auto id = w->ScheduleTimer(50ms, [&] {
+         fired = true;
+      });
+      EXPECT_NE(Worker::NO_TIMER, id);
+      const bool first = w->CancelTimer(id);
+      cancelled.set_value(first && !w->CancelTimer(id));
+   });
+   EXPECT_TRUE(future.get());
+
+   // the cancelled timer no longer counts towards the capacity
+   EXPECT_TRUE(w->TrySchedule([] {}));
+   std::this_thread::sleep_for(100ms);
+   EXPECT_FALSE(fired);
+   EXPECT_EQ(Worker::NO_TIMER, w->ScheduleTimer(1ms, [] {}));
+}
+
+struct DetachedCoroutine
+{
+   struct promise_type
+   {
+      DetachedCoroutine get_return_object() noexcept { return {}; }
+      stdcr::suspend_never initial_suspend() noexcept { return {}; }
+      stdcr::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() noexcept {}
+      void unhandled_exception() noexcept { std::abort(); }
+   };
+};
+
+struct ResumeOn
+{
+   Worker & worker;
+   bool await_ready() const noexcept { return false; }
+   void await_suspend(stdcr::coroutine_handle<> h) { worker.Schedule(h); }
+   void await_resume() const noexcept {}
+};
+
+TEST(WorkerTest, worker_resumes_coroutines_without_allocating)
+{
+   constexpr size_t WARMUP = 10;
+   constexpr size_t RESUMES = 1000;
+   auto w = CreateReadyWorker(16);
+
+   std::promise<size_t> allocations;
+   auto future = allocations.get_future();
+   auto Hop = [](Worker & w, std::promise<size_t> & result) -> DetachedCoroutine {
+      for (size_t i = 0; i < WARMUP; ++i)
+         co_await ResumeOn{w};
+      const size_t before = g_allocations.load();
+      for (size_t i = 0; i < RESUMES; ++i)
+         co_await ResumeOn{w};
+      result.set_value(g_allocations.load() - before);
+   };
+   Hop(*w, allocations);
+
+   ASSERT_EQ(std::future_status::ready, future.wait_for(1s));
+   EXPECT_EQ(0U, future.get());
+}
+
+TEST(WorkerTest, worker_reports_depth_wait_and_run_times)
+{
+   Worker w({"", 10, nullptr, 64, true});
+
+   std::promise<void> started;
+   std::promise<void> unblocker;
+   std::promise<void> finished;
+   auto future = finished.get_future();
+   w.Schedule([&started, f = unblocker.get_future()] {
+      started.set_value();
+      f.wait();
+   });
+   started.get_future().wait(); // the blocker is running, not queued
+   w.Schedule(
+      [] {
+         std::this_thread::sleep_for(5ms);
+      },
+      {.label = "sleep"});
+   w.Schedule([] {}, {.label = "noop"});
+   w.Schedule([&] {
+      finished.set_value();
+   });
+   EXPECT_EQ(3U, w.GetMetrics().depth);
+   std::this_thread::sleep_for(20ms); // lower bound for the wait and run times below
+
+   unblocker.set_value();
+   ASSERT_EQ(std::future_status::ready, future.wait_for(1s));
+
+   // the last task is recorded after it has set the promise
+   auto metrics = w.GetMetrics();
+   for (auto deadline = std::chrono::steady_clock::now() + 1s;
+        metrics.runTime.count < 4U && std::chrono::steady_clock::now() < deadline;
+        metrics = w.GetMetrics())
+      std::this_thread::yield();
+   EXPECT_EQ(0U, metrics.depth);
+   EXPECT_EQ(3U, metrics.peakDepth);
+   EXPECT_EQ(4U, metrics.waitTime.count);
+   EXPECT_LE(20'000U, metrics.waitTime.max);
+   EXPECT_EQ(4U, metrics.runTime.count);
+   EXPECT_LE(20'000U, metrics.runTime.max);
+
+   ASSERT_EQ(2U, metrics.runTimeByLabel.size());
+   EXPECT_EQ("sleep", metrics.runTimeByLabel[0].first);
+   EXPECT_EQ(1U, metrics.runTimeByLabel[0].second.count);
+   EXPECT_LE(5'000U, metrics.runTimeByLabel[0].second.max);
+   EXPECT_EQ("noop", metrics.runTimeByLabel[1].first);
+   EXPECT_EQ(1U, metrics.runTimeByLabel[1].second.count);
+}
+
+TEST(WorkerTest, worker_keeps_priority_order_and_sheds_a_flooded_lane)
+{
+   Worker::Config config{"", std::numeric_limits<size_t>::max(), nullptr};
+   config.lanes[size_t(async::Priority::NORMAL)] = {
+      .capacity = 4,
+      .overflow = Worker::Overflow::REJECT,
+   };
+   config.lanes[size_t(async::Priority::LOW)] = {
+      .capacity = 8,
+      .overflow = Worker::Overflow::DROP_OLDEST,
+      .coalesce = true,
+   };
+   Worker w(config);
+
+   std::vector<int> order;
+   std::vector<int> expected;
+   std::promise<void> finished;
+   auto future = finished.get_future();
+   auto schedule = [&](int value, async::TaskInfo info) {
+      return w.TrySchedule(
+         [&, value] {
+            order.push_back(value);
+            if (order.size() == expected.size())
+               finished.set_value();
+         },
+         info);
+   };
+
+   std::promise<void> started;
+   std::promise<void> unblocker;
+   w.Schedule(
+      [&started, f = unblocker.get_future()] {
+         started.set_value();
+         f.wait();
+      },
+      {.priority = async::Priority::CRITICAL});
+   started.get_future().wait();
+
+   // only the newest 8 survive, and the newest of each duplicate
+   for (int i = 0; i < 1000; ++i)
+      EXPECT_TRUE(schedule(i, {.priority = async::Priority::LOW}));
+   for (int i = 0; i < 100; ++i)
+      EXPECT_TRUE(schedule(1000 + i, {.priority = async::Priority::LOW, .coalesceKey = 7}));
+   for (int i = 0; i < 10; ++i)
+      EXPECT_EQ(i < 4, schedule(2000 + i, {.priority = async::Priority::NORMAL}));
+   for (int i = 0; i < 5; ++i)
+      EXPECT_TRUE(schedule(3000 + i, {.priority = async::Priority::HIGH}));
+   for (int i = 0; i < 5; ++i)
+      EXPECT_TRUE(schedule(4000 + i, {.priority = async::Priority::CRITICAL}));
+
+   for (int i = 0; i < 5; ++i)
+      expected.push_back(4000 + i);
+   for (int i = 0; i < 5; ++i)
+      expected.push_back(3000 + i);
+   for (int i = 0; i < 4; ++i)
+      expected.push_back(2000 + i);
+   for (int i = 993; i < 1000; ++i)
+      expected.push_back(i);
+   expected.push_back(1099);
+
+   const std::array<size_t, async::PRIORITY_COUNT> shed{0, 0, 6, 992 + 1 + 99};
+   EXPECT_EQ(shed, w.GetMetrics().shed);
+
+   unblocker.set_value();
+   ASSERT_EQ(std::future_status::ready, future.wait_for(1s));
+   EXPECT_EQ(expected, order);
+}
+
+class FakeCommand : public cmd::ICommand
+{
+public:
+   FakeCommand(int32_t id, bool supersedable)
+      : m_id(id)
+      , m_supersedable(supersedable)
+   {}
+   int32_t GetId() const override { return m_id; }
+   std::string_view GetName() const override { return "FakeCommand"; }
+   size_t GetArgsCount() const override { return 0; }
+   std::string_view GetArgAt(size_t) const override { return {}; }
+   bool IsSupersedable() const override { return m_supersedable; }
+
+private:
+   const int32_t m_id;
+   const bool m_supersedable;
+};
+
+TEST(WorkerTest, worker_coalesces_supersedable_commands_of_a_batch)
+{
+   Worker::Config config{"", std::numeric_limits<size_t>::max(), nullptr};
+   config.lanes[size_t(async::Priority::LOW)] = {
+      .capacity = 16,
+      .overflow = Worker::Overflow::DROP_OLDEST,
+      .coalesce = true,
+   };
+   Worker w(config);
+
+   std::promise<void> started;
+   std::promise<void> unblocker;
+   w.Schedule([&started, f = unblocker.get_future()] {
+      started.set_value();
+      f.wait();
+   });
+   started.get_future().wait();
+
+   // a flood of toasts with a few other commands in between, and one notification at the end
+   FakeCommand toast(COMMAND_ID(1), true);
+   FakeCommand notification(COMMAND_ID(2), true);
+   FakeCommand other(COMMAND_ID(3), false);
+   std::vector<cmd::Invocation> batch;
+   for (int32_t i = 0; i < 100; ++i) {
+      batch.push_back({mem::pool_ptr<cmd::ICommand>(&toast), i});
+      if (i % 10 == 0)
+         batch.push_back({mem::pool_ptr<cmd::ICommand>(&other), 1000 + i});
+   }
+   batch.push_back({mem::pool_ptr<cmd::ICommand>(&notification), 2000});
+
+   std::vector<int32_t> passed;
+   std::vector<int32_t> shed;
+   std::promise<void> finished;
+   async::ScheduleCommands(
+      batch,
+      [&](auto && task, const async::TaskInfo & info) {
+         w.Schedule(std::move(task), info);
+      },
+      [&](mem::pool_ptr<cmd::ICommand> &&, int32_t id) {
+         passed.push_back(id);
+         if (id == 2000)
+            finished.set_value();
+      },
+      [&](int32_t id) {
+         shed.push_back(id);
+      });
+
+   std::vector<int32_t> expectedShed(99);
+   std::iota(expectedShed.begin(), expectedShed.end(), 0);
+   EXPECT_EQ(expectedShed, shed);
+   EXPECT_EQ(99U, w.GetMetrics().shed[size_t(async::Priority::LOW)]);
+
+   unblocker.set_value();
+   ASSERT_EQ(std::future_status::ready, finished.get_future().wait_for(1s));
+   std::vector<int32_t> expectedPassed;
+   for (int32_t i = 0; i < 100; i += 10)
+      expectedPassed.push_back(1000 + i);
+   expectedPassed.push_back(99);
+   expectedPassed.push_back(2000);
+   EXPECT_EQ(expectedPassed, passed);
+}
+
+TEST(WorkerTest, worker_burst_throughput_with_and_without_batching)
+{
+   constexpr size_t TASKS = 200'000;
+
+   for (size_t batchSize : {1U, 64U}) {
+      Worker w({"", TASKS, nullptr, batchSize});
+      std::atomic_size_t executed = 0;
+      std::promise<void> finished;
+      auto future = finished.get_future();
+
+      // hold the worker until the whole burst is queued
+      std::promise<void> unblocker;
+      w.Schedule([f = unblocker.get_future()] {
+         f.wait();
+      });
+      for (size_t i = 0; i < TASKS; ++i) {
+         w.Schedule([&] {
+            if (executed.fetch_add(1, std::memory_order_relaxed) + 1 == TASKS)
+               finished.set_value();
+         });
+      }
+      const auto start = std::chrono::steady_clock::now();
+      unblocker.set_value();
+      EXPECT_EQ(std::future_status::ready, future.wait_for(10s));
+
+      const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+         std::chrono::steady_clock::now() - start);
+      RecordProperty("tasks_per_second_batch_" + std::to_string(batchSize),
+                     std::to_string(executed.load() * 1'000'000 / (elapsed.count() + 1)));
+   }
+}
+
+TEST(WorkerTest, worker_throughput_under_producer_contention)
+{
+   constexpr size_t PRODUCERS = 4;
+   constexpr size_t TASKS_PER_PRODUCER = 100'000;
+   auto w = CreateReadyWorker(1024);
+
+   std::atomic_size_t executed = 0;
+   std::promise<void> finished;
+   auto future = finished.get_future();
+
+   const auto start = std::chrono::steady_clock::now();
+   std::vector<std::thread> producers;
+   for (size_t i = 0; i < PRODUCERS; ++i) {
+      producers.emplace_back([&] {
+         for (size_t j = 0; j < TASKS_PER_PRODUCER; ++j) {
+            w->Schedule([&] {
+               if (executed.fetch_add(1, std::memory_order_relaxed) + 1 ==
+                   PRODUCERS * TASKS_PER_PRODUCER)
+                  finished.set_value();
+            });
+         }
+      });
+   }
+   for (auto & t : producers)
+      t.join();
+
+   auto status = future.wait_for(10s);
+   EXPECT_EQ(std::future_status::ready, status);
+   EXPECT_EQ(PRODUCERS * TASKS_PER_PRODUCER, executed.load());
+
+   const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+   RecordProperty("tasks_per_second",
+                  std::to_string(executed.load() * 1'000'000 / (elapsed.count() + 1)));
+}
+
+std::vector<int> AdvanceAndCollect(TimingWheel<int> & wheel, uint64_t now)
+{
+   std::vector<int> expired;
+   wheel.Advance(now);
+   for (int value; wheel.PopExpired(value);)
+      expired.push_back(value);
+   return expired;
+}
+
+TEST(TimingWheelTest, entries_expire_in_deadline_then_insertion_order)
+{
+   TimingWheel<int> wheel;
+   wheel.Insert(5000, 1); // starts on a high level
+   wheel.Insert(70, 2);
+   wheel.Insert(5000, 3);
+   EXPECT_EQ(64U, wheel.NextEventTick()); // start of the slot holding 70
+
+   EXPECT_EQ(std::vector<int>{}, AdvanceAndCollect(wheel, 69));
+   EXPECT_EQ(std::vector<int>{2}, AdvanceAndCollect(wheel, 4990));
+
+   wheel.Insert(5000, 4); // lands on the lowest level now
+   wheel.Insert(4995, 5);
+   EXPECT_EQ((std::vector<int>{5, 1, 3, 4}), AdvanceAndCollect(wheel, 5000));
+   EXPECT_EQ(0U, wheel.Size());
+   EXPECT_EQ(wheel.NEVER, wheel.NextEventTick());
+}
+
+TEST(TimingWheelTest, cancelled_entries_never_expire)
+{
+   TimingWheel<int> wheel(100);
+   auto first = wheel.Insert(150, 1);
+   wheel.Insert(150, 2);
+   auto far = wheel.Insert(100'000, 3);
+   EXPECT_EQ(3U, wheel.Size());
+
+   EXPECT_TRUE(wheel.Cancel(first));
+   EXPECT_FALSE(wheel.Cancel(first));
+   EXPECT_TRUE(wheel.Cancel(far));
+   EXPECT_EQ(1U, wheel.Size());
+
+   EXPECT_EQ(std::vector<int>{2}, AdvanceAndCollect(wheel, 200'000));
+   EXPECT_EQ(wheel.NEVER, wheel.NextEventTick());
+
+   // handles of reused entries stay invalid
+   wheel.Insert(300'000, 4);
+   EXPECT_FALSE(wheel.Cancel(first));
+   EXPECT_EQ(1U, wheel.Size());
+}
+
+TEST(TimingWheelTest, deadlines_beyond_the_wheel_range_expire_on_time)
+{
+   constexpr uint64_t DAY = 24ULL * 3600 * 1000;
+   TimingWheel<int> wheel;
+   wheel.Insert(DAY, 1);
+   wheel.Insert(DAY + 1, 2);
+   wheel.Insert(0, 3);
+
+   EXPECT_EQ(std::vector<int>{3}, AdvanceAndCollect(wheel, 0));
+   for (uint64_t now = 0; now < DAY - 1000; now += 997)
+      EXPECT_EQ(std::vector<int>{}, AdvanceAndCollect(wheel, now));
+   EXPECT_EQ(std::vector<int>{1}, AdvanceAndCollect(wheel, DAY));
+   EXPECT_EQ(DAY + 1, wheel.NextEventTick());
+   EXPECT_EQ(std::vector<int>{2}, AdvanceAndCollect(wheel, DAY + 1));
+}
+
+TEST(WorkerTest, worker_executes_delayed_tasks_with_equal_deadlines_in_order)
+{
+   auto w = CreateReadyWorker(100);
+
+   std::vector<int> order;
+   std::promise<void> finished;
+   auto future = finished.get_future();
+   const auto delay = 50ms;
+   for (int i = 0; i < 50; ++i)
+      w->Schedule(delay - std::chrono::milliseconds(i % 2), [&order, i] {
+         order.push_back(i);
+      });
+   w->Schedule(delay + 1ms, [&] {
+      finished.set_value();
+   });
+   EXPECT_EQ(std::future_status::ready, future.wait_for(1s));
+
+   ASSERT_EQ(50U, order.size());
+   for (size_t i = 1; i < order.size(); ++i) {
+      if (order[i] % 2 == order[i - 1] % 2) {
+         EXPECT_LT(order[i - 1], order[i]);
+      }
+   }
+}
+
 } // namespace
@@ -0,0 +1,229 @@
+#include <gtest/gtest.h>
+
+#include "../src/common/executor.hpp"
+#include "../src/common/strand.hpp"
+#include "../src/common/threadpool.hpp"
+
+#include "utils/task.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+using namespace std::chrono_literals;
+using async::Strand;
+using async::ThreadPool;
+
+TEST(ThreadPoolTest, pool_runs_tasks_from_many_producers)
+{
+   constexpr size_t PRODUCERS = 4;
+   constexpr size_t TASKS_PER_PRODUCER = 10'000;
+   ThreadPool pool({"", 4, nullptr});
+
+   std::atomic_size_t executed = 0;
+   std::promise<void> finished;
+   auto future = finished.get_future();
+   std::vector<std::thread> producers;
+   for (size_t i = 0; i < PRODUCERS; ++i) {
+      producers.emplace_back([&] {
+         for (size_t j = 0; j < TASKS_PER_PRODUCER; ++j) {
+            pool.Submit([&] {
+               if (executed.fetch_add(1) + 1 == PRODUCERS * TASKS_PER_PRODUCER)
+                  finished.set_value();
+            });
+         }
+      });
+   }
+   for (auto & t : producers)
+      t.join();
+
+   ASSERT_EQ(std::future_status::ready, future.wait_for(5s));
+   EXPECT_EQ(PRODUCERS * TASKS_PER_PRODUCER, executed.load());
+}
+
+TEST(ThreadPoolTest, idle_threads_steal_tasks_spawned_by_a_busy_one)
+{
+   constexpr size_t SUBTASKS = 16;
+   ThreadPool pool({"", 4, nullptr});
+
+   std::mutex sync;
+   std::set<std::thread::id> threads;
+   std::atomic_size_t executed = 0;
+   std::promise<void> finished;
+   auto future = finished.get_future();
+
+   const auto start = std::chrono::steady_clock::now();
+   pool.Submit([&] {
+      // all of them land in the queue of this thread
+      for (size_t i = 0; i < SUBTASKS; ++i) {
+         pool.Submit([&] {
+            std::this_thread::sleep_for(20ms);
+            {
+               std::lock_guard lock(sync);
+               threads.insert(std::this_thread::get_id());
+            }
+            if (executed.fetch_add(1) + 1 == SUBTASKS)
+               finished.set_value();
+         });
+      }
+   });
+
+   ASSERT_EQ(std::future_status::ready, future.wait_for(5s));
+   EXPECT_LT(std::chrono::steady_clock::now() - start, SUBTASKS * 20ms / 2);
+   std::lock_guard lock(sync);
+   EXPECT_LT(1U, threads.size());
+}
+
+TEST(ThreadPoolTest, pool_reports_exceptions_and_keeps_going)
+{
+   std::promise<std::string> exception;
+   auto future = exception.get_future();
+   ThreadPool pool({"", 2, [&](std::string_view, std::string_view ex) {
+                       exception.set_value(std::string(ex));
+                    }});
+
+   pool.Submit([] {
+      throw std::runtime_error("oops");
+   });
+   ASSERT_EQ(std::future_status::ready, future.wait_for(1s));
+   EXPECT_EQ("oops", future.get());
+
+   std::promise<void> done;
+   pool.Submit([&] {
+      done.set_value();
+   });
+   EXPECT_EQ(std::future_status::ready, done.get_future().wait_for(1s));
+}
+
+TEST(StrandTest, strand_runs_tasks_in_order_and_one_at_a_time)
+{
+   constexpr size_t PRODUCERS = 4;
+   constexpr size_t TASKS_PER_PRODUCER = 5'000;
+   ThreadPool pool({"", 4, nullptr});
+   Strand strand(pool);
+
+   // deliberately unsynchronized, the strand must provide the ordering
+   bool inside = false;
+   size_t overlaps = 0;
+   std::vector<std::vector<size_t>> order(PRODUCERS);
+   std::atomic_size_t executed = 0;
+   std::promise<void> finished;
+   auto future = finished.get_future();
+
+   std::vector<std::thread> producers;
+   for (size_t i = 0; i < PRODUCERS; ++i) {
+      producers.emplace_back([&, i] {
+         for (size_t j = 0; j < TASKS_PER_PRODUCER; ++j) {
+            strand.Post([&, i, j] {
+               if (std::exchange(inside, true))
+                  ++overlaps;
+               EXPECT_TRUE(strand.IsCurrent());
+               order[i].push_back(j);
+               inside = false;
+               if (executed.fetch_add(1) + 1 == PRODUCERS * TASKS_PER_PRODUCER)
+                  finished.set_value();
+            });
+         }
+      });
+   }
+   for (auto & t : producers)
+      t.join();
+
+   ASSERT_EQ(std::future_status::ready, future.wait_for(5s));
+   EXPECT_FALSE(strand.IsCurrent());
+   EXPECT_EQ(0U, overlaps);
+   for (const auto & fromProducer : order) {
+      ASSERT_EQ(TASKS_PER_PRODUCER, fromProducer.size());
+      EXPECT_TRUE(std::is_sorted(fromProducer.begin(), fromProducer.end()));
+   }
+}
+
+TEST(StrandTest, long_strand_lets_other_tasks_run_between_batches)
+{
+   constexpr size_t TASKS = 200;
+   ThreadPool pool({"", 1, nullptr});
+   Strand strand(pool);
+
+   // the strand is filled before its drain starts
+   std::promise<void> unblocker;
+   pool.Submit([f = unblocker.get_future()] {
+      f.wait();
+   });
+
+   constexpr size_t UNRELATED = std::numeric_limits<size_t>::max();
+   std::vector<size_t> order; // one pool thread, no locking needed
+   std::promise<void> finished;
+   auto future = finished.get_future();
+   for (size_t i = 0; i < TASKS; ++i) {
+      strand.Post([&, i] {
+         if (i == 0) {
+            pool.Submit([&] {
+               order.push_back(UNRELATED);
+            });
+         }
+         order.push_back(i);
+         if (i + 1 == TASKS)
+            finished.set_value();
+      });
+   }
+   unblocker.set_value();
+   ASSERT_EQ(std::future_status::ready, future.wait_for(1s));
+
+   const auto unrelated = std::find(order.begin(), order.end(), UNRELATED);
+   ASSERT_NE(order.end(), unrelated);
+   EXPECT_EQ(64, std::distance(order.begin(), unrelated)); // right after the first batch
+}
+
+TEST(StrandTest, coroutine_offloads_to_pool_and_returns_to_strand)
+{
+   ThreadPool pool({"", 2, nullptr});
+   Strand strand(pool);
+
+   using Task = cr::TaskHandle<size_t, async::Executor<Strand>>;
+   using RootTask = cr::TaskHandle<void, async::Executor<Strand>>;
+   std::promise<size_t> result;
+   auto future = result.get_future();
+
+   auto compute = [](ThreadPool & pool, Strand & strand) -> Task {
+      EXPECT_TRUE(strand.IsCurrent());
+      co_await async::ResumeOn(pool);
+      EXPECT_FALSE(strand.IsCurrent());
+      size_t sum = 0;
+      for (size_t i = 1; i <= 100; ++i)
+         sum += i;
+      co_await async::ResumeOn(strand);
+      EXPECT_TRUE(strand.IsCurrent());
+      co_return sum;
+   };
+   auto outer = [](ThreadPool & pool,
+                   Strand & strand,
+                   Task (*compute)(ThreadPool &, Strand &),
+                   std::promise<size_t> & result) -> RootTask {
+      const size_t sum = co_await compute(pool, strand);
+      EXPECT_TRUE(strand.IsCurrent());
+      result.set_value(sum);
+   };
+
+   auto task = outer(pool, strand, compute, result);
+   task.Run({&strand});
+   ASSERT_EQ(std::future_status::ready, future.wait_for(1s));
+   EXPECT_EQ(5050U, future.get());
+
+   // let the frames finish on the strand before they are destroyed here
+   std::promise<void> drained;
+   strand.Post([&] {
+      drained.set_value();
+   });
+   drained.get_future().wait();
+}
+
+} // namespace
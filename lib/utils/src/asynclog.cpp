@@ -0,0 +1,264 @@
+#include "utils/asynclog.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string_view>
+
+namespace {
+
+constexpr auto TAG = "AsyncLog";
+constexpr char LEVEL_LETTERS[] = {'D', 'I', 'W', 'E', 'F'};
+
+// copies as much as fits and terminates
+template <size_t N>
+void CopyTruncated(std::array<char, N> & dest, const char * src) noexcept
+{
+   const size_t length = ::strnlen(src, N - 1);
+   std::memcpy(dest.data(), src, length);
+   dest[length] = '\0';
+}
+
+} // namespace
+
+struct AsyncLogSink::Record
+{
+   std::chrono::system_clock::time_point time;
+   Level level;
+   std::array<char, MAX_TAG_LENGTH + 1> tag;
+   std::array<char, Log::MAX_LINE_LENGTH + 1> text;
+};
+
+struct AsyncLogSink::Cell
+{
+   std::atomic<size_t> sequence;
+   Record record;
+};
+
+std::atomic<AsyncLogSink *> AsyncLogSink::s_instance = nullptr;
+
+AsyncLogSink::AsyncLogSink(const Config & config)
+   : m_config(config)
+   , m_mask(std::bit_ceil(std::max<size_t>(config.capacity, 2U)) - 1U)
+   , m_cells(std::make_unique<Cell[]>(m_mask + 1U))
+   , m_downstream{Log::s_debugHandler,
+                  Log::s_infoHandler,
+                  Log::s_warningHandler,
+                  Log::s_errorHandler,
+                  Log::s_fatalHandler}
+{
+   for (size_t i = 0; i <= m_mask; ++i)
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+
+   [[maybe_unused]] AsyncLogSink * previous = s_instance.exchange(this);
+   assert(previous == nullptr);
+   m_thread = std::thread(&AsyncLogSink::Run, this);
+
+   Log::s_debugHandler = &AsyncLogSink::Enqueue<DEBUG>;
+   Log::s_infoHandler = &AsyncLogSink::Enqueue<INFO>;
+   Log::s_warningHandler = &AsyncLogSink::Enqueue<WARNING>;
+   Log::s_errorHandler = &AsyncLogSink::Enqueue<ERROR>;
+   Log::s_fatalHandler = &AsyncLogSink::FlushAndFail;
+}
+
+AsyncLogSink::~AsyncLogSink()
+{
+   Log::s_debugHandler = m_downstream[DEBUG];
+   Log::s_infoHandler = m_downstream[INFO];
+   Log::s_warningHandler = m_downstream[WARNING];
+   Log::s_errorHandler = m_downstream[ERROR];
+   Log::s_fatalHandler = m_downstream[FATAL];
+
+   Flush();
+   {
+      std::lock_guard lock(m_mutex);
+      m_stopping = true;
+   }
+   m_wake.notify_one();
+   m_thread.join();
+   s_instance.store(nullptr);
+}
+
+void AsyncLogSink::Flush()
+{
+   const size_t target = m_enqueuePos.load(std::memory_order_acquire);
+   std::unique_lock lock(m_mutex);
+   m_flushTarget = std::max(m_flushTarget, target);
+   m_wake.notify_one();
+   m_flushed.wait(lock, [&] {
+      return m_written >= target;
+   });
+}
+
+template <AsyncLogSink::Level L>
+void AsyncLogSink::Enqueue(const char * tag, const char * text)
+{
+   if (AsyncLogSink * sink = s_instance.load(std::memory_order_acquire))
+      sink->Push(L, tag, text);
+}
+
+void AsyncLogSink::FlushAndFail(const char * tag, const char * text)
+{
+   AsyncLogSink * sink = s_instance.load(std::memory_order_acquire);
+   if (!sink)
+      return;
+   sink->Flush();
+   if (Log::Handler fatal = sink->m_downstream[FATAL]) {
+      fatal(tag, text);
+   } else {
+      // formatted on the stack, the batches and the cached time belong to the background thread
+      const std::time_t t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+      std::tm tm{};
+      std::array<char, 32> timeText{};
+      std::strftime(timeText.data(), timeText.size(), "%F %T", ::gmtime_r(&t, &tm));
+      std::array<char, sizeof(Record::tag) + sizeof(Record::text) + 40> line;
+      const int length = std::snprintf(line.data(),
+                                       line.size(),
+                                       "%s F/%.*s: %.*s\n",
+                                       timeText.data(),
+                                       static_cast<int>(MAX_TAG_LENGTH),
+                                       tag,
+                                       static_cast<int>(Log::MAX_LINE_LENGTH),
+                                       text);
+      if (length > 0)
+         std::fwrite(line.data(), 1, std::min<size_t>(length, line.size() - 1), stderr);
+      std::fflush(stderr);
+   }
+}
+
+void AsyncLogSink::Push(Level level, const char * tag, const char * text)
+{
+   if (TryPush(level, tag, text))
+      return;
+   if (m_config.overflow == Overflow::DROP) {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   do {
+      m_wake.notify_one();
+      std::this_thread::yield();
+   } while (!TryPush(level, tag, text));
+}
+
+bool AsyncLogSink::TryPush(Level level, const char * tag, const char * text) noexcept
+{
+   // bounded queue of D. Vyukov, a cell is free for position pos when its sequence equals pos
+   // and holds a record once it is pos + 1
+   size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+   Cell * cell;
+   for (;;) {
+      cell = &m_cells[pos & m_mask];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+         if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            break;
+      } else if (diff < 0) {
+         return false;
+      } else {
+         pos = m_enqueuePos.load(std::memory_order_relaxed);
+      }
+   }
+   Record & record = cell->record;
+   record.time = std::chrono::system_clock::now();
+   record.level = level;
+   CopyTruncated(record.tag, tag);
+   CopyTruncated(record.text, text);
+   cell->sequence.store(pos + 1, std::memory_order_release);
+   return true;
+}
+
+void AsyncLogSink::Run()
+{
+   for (;;) {
+      const size_t drained = Drain();
+
+      std::unique_lock lock(m_mutex);
+      m_written = m_dequeuePos;
+      m_flushed.notify_all();
+      if (m_written < m_flushTarget) {
+         // a producer has claimed a cell but not filled it yet
+         lock.unlock();
+         std::this_thread::yield();
+         continue;
+      }
+      if (m_stopping)
+         return;
+      if (drained == 0) {
+         m_wake.wait_for(lock, m_config.flushInterval, [this] {
+            return m_stopping || m_flushTarget > m_written || HasRecord();
+         });
+      }
+   }
+}
+
+bool AsyncLogSink::HasRecord() const noexcept
+{
+   const Cell & cell = m_cells[m_dequeuePos & m_mask];
+   return cell.sequence.load(std::memory_order_acquire) == m_dequeuePos + 1;
+}
+
+size_t AsyncLogSink::Drain()
+{
+   size_t count = 0;
+   {
+      std::lock_guard lock(m_mutex);
+      for (;; ++count, ++m_dequeuePos) {
+         if (!HasRecord())
+            break;
+         Cell & cell = m_cells[m_dequeuePos & m_mask];
+         Output(cell.record);
+         cell.sequence.store(m_dequeuePos + m_mask + 1, std::memory_order_release);
+      }
+
+      const size_t dropped = m_dropped.load(std::memory_order_relaxed);
+      if (dropped != m_reportedDropped) {
+         Record record{std::chrono::system_clock::now(), WARNING, {}, {}};
+         CopyTruncated(record.tag, TAG);
+         std::snprintf(record.text.data(),
+                       record.text.size(),
+                       "%zu log line(s) dropped",
+                       dropped - m_reportedDropped);
+         m_reportedDropped = dropped;
+         Output(record);
+      }
+   }
+
+   if (!m_stdoutBatch.empty()) {
+      std::fwrite(m_stdoutBatch.data(), 1, m_stdoutBatch.size(), stdout);
+      std::fflush(stdout);
+      m_stdoutBatch.clear();
+   }
+   if (!m_stderrBatch.empty()) {
+      std::fwrite(m_stderrBatch.data(), 1, m_stderrBatch.size(), stderr);
+      std::fflush(stderr);
+      m_stderrBatch.clear();
+   }
+   return count;
+}
+
+void AsyncLogSink::Output(const Record & record)
+{
+   if (Log::Handler handler = m_downstream[record.level]) {
+      handler(record.tag.data(), record.text.data());
+      return;
+   }
+
+   const std::time_t t = std::chrono::system_clock::to_time_t(record.time);
+   if (t != m_timeTextSecond) {
+      [[maybe_unused]] const size_t length =
+         std::strftime(m_timeText.data(), m_timeText.size(), "%F %T", std::gmtime(&t));
+      assert(length > 0);
+      m_timeTextSecond = t;
+   }
+   std::string & batch = record.level <= INFO ? m_stdoutBatch : m_stderrBatch;
+   batch.append(m_timeText.data());
+   batch.append({' ', LEVEL_LETTERS[record.level], '/'});
+   batch.append(record.tag.data());
+   batch.append(": ");
+   batch.append(record.text.data());
+   batch.push_back('\n');
+}
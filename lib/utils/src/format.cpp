@@ -1,5 +1,7 @@
 #include "utils/format.hpp"
 
+#include <algorithm>
+
 namespace fmt::internal {
 
 std::span<char> WriteAsText(char arg, std::span<char> dest)
@@ -48,20 +50,6 @@ std::span<char> WriteAsText(const std::string & arg, std::span<char> dest)
 }
 
 
-size_t ParsePlaceholder(std::string_view from)
-{
-   static constexpr std::string_view placeholder = "{}";
-   return from.starts_with(placeholder) ? placeholder.size() : 0;
-}
-
-size_t CountPlaceholders(std::string_view fmt)
-{
-   size_t count = 0;
-   for (size_t i = 0; i < fmt.size(); ++i)
-      count += ParsePlaceholder(fmt.substr(i)) ? 1u : 0u;
-   return count;
-}
-
 std::tuple<std::string_view, std::span<char>> CopyUntilPlaceholder(std::string_view src,
                                                                    std::span<char> dest)
 {
@@ -0,0 +1,136 @@
+#ifndef ASYNC_GENERATOR_HPP
+#define ASYNC_GENERATOR_HPP
+
+#include "utils/task.hpp"
+
+#include <exception>
+#include <optional>
+#include <utility>
+#include <variant>
+
+namespace cr {
+
+template <TaskResult T, Executor E>
+class AsyncGenerator;
+
+namespace internal {
+
+template <TaskResult T, Executor E>
+struct GeneratorPromise : Promise<void, E>
+{
+   std::optional<T> current;
+
+   AsyncGenerator<T, E> get_return_object() { return AsyncGenerator<T, E>{*this}; }
+
+   auto yield_value(T value)
+   {
+      struct YieldAwaiter
+      {
+         GeneratorPromise & p;
+
+         bool await_ready() const noexcept { return false; }
+         stdcr::coroutine_handle<> await_suspend(stdcr::coroutine_handle<>) noexcept
+         {
+            // only the consumer resumes us from here, so dropping the generator can destroy us
+            p.withdraw = [](void *) noexcept {
+               return true;
+            };
+            return Transfer(p.Executor(), p.parentHandle);
+         }
+         void await_resume() const
+         {
+            p.withdraw = nullptr;
+            if (p.canceled)
+               throw CanceledException{};
+         }
+      };
+      current.emplace(std::move(value));
+      return YieldAwaiter{*this};
+   }
+};
+
+} // namespace internal
+
+// Lazily produced sequence. The body runs only while the consumer waits in co_await Next(), up to
+// the next co_yield, so a slow consumer holds the producer back and only one element exists at a
+// time. The body may co_await like any task, and dropping the generator cancels it the same way
+// as dropping a TaskHandle.
+template <TaskResult T, Executor E = InlineExecutor>
+class AsyncGenerator
+{
+public:
+   using promise_type = internal::GeneratorPromise<T, E>;
+   using handle_type = stdcr::coroutine_handle<promise_type>;
+
+   AsyncGenerator() noexcept = default;
+   explicit AsyncGenerator(promise_type & promise) noexcept
+      : m_handle(handle_type::from_promise(promise))
+   {}
+   AsyncGenerator(AsyncGenerator && other) noexcept
+      : m_handle(std::exchange(other.m_handle, nullptr))
+      , m_started(other.m_started)
+   {}
+   AsyncGenerator & operator=(AsyncGenerator && other) noexcept
+   {
+      AsyncGenerator(std::move(other)).Swap(*this);
+      return *this;
+   }
+   ~AsyncGenerator()
+   {
+      if (!m_handle)
+         return;
+      m_handle.promise().canceled = true;
+      if (!m_started || m_handle.done() || m_handle.promise().Withdraw())
+         m_handle.destroy();
+   }
+
+   // co_await Next() gives the next element, or nullopt once the body has returned. An exception
+   // thrown by the body is rethrown here once, after that the sequence is over.
+   auto Next(E executor = {})
+   {
+      struct NextAwaiter
+      {
+         handle_type handle;
+
+         bool await_ready() const noexcept { return !handle || handle.done(); }
+         stdcr::coroutine_handle<> await_suspend(stdcr::coroutine_handle<> h)
+         {
+            handle.promise().parentHandle = h;
+            handle.promise().current.reset();
+            return internal::Transfer(handle.promise().Executor(), handle);
+         }
+         bool Withdraw() noexcept { return handle.promise().Withdraw(); }
+         std::optional<T> await_resume()
+         {
+            if (!handle)
+               return std::nullopt;
+            auto & promise = handle.promise();
+            if (auto * exptr = std::get_if<std::exception_ptr>(&promise.value)) {
+               std::exception_ptr exception = std::move(*exptr);
+               promise.value.template emplace<std::monostate>();
+               std::rethrow_exception(std::move(exception));
+            }
+            return std::exchange(promise.current, std::nullopt);
+         }
+      };
+      if (m_handle && !m_handle.done()) {
+         m_handle.promise().Executor() = executor;
+         m_started = true;
+      }
+      return NextAwaiter{m_handle};
+   }
+
+   void Swap(AsyncGenerator & other) noexcept
+   {
+      std::swap(m_handle, other.m_handle);
+      std::swap(m_started, other.m_started);
+   }
+
+private:
+   handle_type m_handle = nullptr;
+   bool m_started = false;
+};
+
+} // namespace cr
+
+#endif // ASYNC_GENERATOR_HPP
@@ -0,0 +1,98 @@
+#ifndef ASYNC_LOG_HPP
+#define ASYNC_LOG_HPP
+
+#include "utils/log.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Takes log output off the logging threads. While a sink is alive, Log calls copy their line into
+// a fixed-size record in a lock-free ring and return, a background thread then passes the records
+// in batches to the handlers that were set before the sink, or if there were none, timestamps them
+// and writes them to stdout and stderr like Log does. Log::Fatal() waits until everything logged
+// before it is out, then goes to the previous handler directly from the calling thread.
+// Only one sink can be alive at a time.
+class AsyncLogSink
+{
+public:
+   enum class Overflow : uint8_t
+   {
+      DROP,  // count the line as dropped and go on, the count is logged once there is room
+      BLOCK, // wait for the background thread to make room
+   };
+
+   struct Config
+   {
+      size_t capacity = 1024; // records, rounded up to a power of two
+      Overflow overflow = Overflow::DROP;
+      std::chrono::milliseconds flushInterval{50};
+   };
+
+   static constexpr size_t MAX_TAG_LENGTH = 31;
+
+   explicit AsyncLogSink(const Config & config);
+   ~AsyncLogSink(); // flushes and puts the previous handlers back
+   AsyncLogSink(const AsyncLogSink &) = delete;
+   AsyncLogSink & operator=(const AsyncLogSink &) = delete;
+
+   // blocks until every line logged before the call has been handed over
+   void Flush();
+   size_t GetDroppedCount() const noexcept { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+   enum Level : uint8_t
+   {
+      DEBUG,
+      INFO,
+      WARNING,
+      ERROR,
+      FATAL,
+      LEVEL_COUNT
+   };
+   struct Record;
+   struct Cell;
+
+   template <Level L>
+   static void Enqueue(const char * tag, const char * text);
+   static void FlushAndFail(const char * tag, const char * text);
+
+   void Push(Level level, const char * tag, const char * text);
+   bool TryPush(Level level, const char * tag, const char * text) noexcept;
+   void Run();
+   bool HasRecord() const noexcept;
+   size_t Drain();
+   void Output(const Record & record);
+
+   static std::atomic<AsyncLogSink *> s_instance;
+
+   const Config m_config;
+   const size_t m_mask;
+   std::unique_ptr<Cell[]> m_cells;
+   alignas(64) std::atomic<size_t> m_enqueuePos = 0;
+   alignas(64) size_t m_dequeuePos = 0; // background thread only
+   std::atomic<size_t> m_dropped = 0;
+   size_t m_reportedDropped = 0; // background thread only
+   std::array<Log::Handler, LEVEL_COUNT> m_downstream;
+   std::string m_stdoutBatch; // background thread only
+   std::string m_stderrBatch; // background thread only
+   int64_t m_timeTextSecond = -1;
+   std::array<char, 32> m_timeText{};
+
+   std::mutex m_mutex;
+   std::condition_variable m_wake;
+   std::condition_variable m_flushed;
+   size_t m_written = 0;
+   size_t m_flushTarget = 0;
+   bool m_stopping = false;
+   std::thread m_thread;
+};
+
+#endif // ASYNC_LOG_HPP
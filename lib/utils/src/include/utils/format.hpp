@@ -1,6 +1,7 @@
 #ifndef FORMAT_HPP
 #define FORMAT_HPP
 
+#include <array>
 #include <cassert>
 #include <charconv>
 #include <concepts>
@@ -38,21 +39,99 @@ concept Writable = requires(T && arg, std::span<char> buf) {
 };
 // clang-format on
 
-size_t ParsePlaceholder(std::string_view from);
-size_t CountPlaceholders(std::string_view fmt);
+constexpr size_t ParsePlaceholder(std::string_view from)
+{
+   constexpr std::string_view placeholder = "{}";
+   return from.starts_with(placeholder) ? placeholder.size() : 0;
+}
+constexpr size_t CountPlaceholders(std::string_view fmt)
+{
+   size_t count = 0;
+   for (size_t i = 0; i < fmt.size(); ++i)
+      count += ParsePlaceholder(fmt.substr(i)) ? 1u : 0u;
+   return count;
+}
 std::tuple<std::string_view, std::span<char>> CopyUntilPlaceholder(std::string_view src,
                                                                    std::span<char> dest);
 
+void PlaceholderCountDoesNotMatchArgumentCount(); // not constexpr, fails the build when called
+
 } // namespace internal
 
 template <typename T>
 concept Formattable = internal::Writable<T>;
 
+// Format string checked at compile time against the number of arguments and split into the
+// literal text around the placeholders, so formatting does not need to scan it.
+template <typename... Ts>
+class FormatString
+{
+public:
+   template <typename S>
+      requires std::convertible_to<const S &, std::string_view>
+   consteval FormatString(const S & fmt)
+   {
+      std::string_view rest = fmt;
+      if (internal::CountPlaceholders(rest) != sizeof...(Ts))
+         internal::PlaceholderCountDoesNotMatchArgumentCount();
+      for (size_t i = 0; i < sizeof...(Ts); ++i) {
+         size_t pos = 0;
+         while (!internal::ParsePlaceholder(rest.substr(pos)))
+            ++pos;
+         m_segments[i] = rest.substr(0, pos);
+         rest.remove_prefix(pos + internal::ParsePlaceholder(rest.substr(pos)));
+      }
+      m_segments.back() = rest;
+   }
+
+   constexpr const std::array<std::string_view, sizeof...(Ts) + 1> & Segments() const noexcept
+   {
+      return m_segments;
+   }
+
+private:
+   std::array<std::string_view, sizeof...(Ts) + 1> m_segments{};
+};
+
+// format string only known at run time, see Runtime()
+struct RuntimeString
+{
+   std::string_view fmt;
+};
+
+// opts out of the compile-time check, superfluous arguments are then appended to the end and
+// placeholders without argument are left out
+constexpr RuntimeString Runtime(std::string_view fmt) noexcept
+{
+   return RuntimeString{fmt};
+}
+
+template <Formattable... Ts>
+std::span<char> Format(std::span<char> buffer,
+                       FormatString<std::type_identity_t<Ts>...> fmt,
+                       Ts &&... args)
+{
+   using namespace internal;
+   if (buffer.empty())
+      return buffer;
+   const auto & segments = fmt.Segments();
+   size_t index = 0;
+   auto ProcessArg = [&](auto && arg) {
+      buffer = WriteAsText(segments[index++], buffer);
+      if (!buffer.empty())
+         buffer = WriteAsText(std::forward<decltype(arg)>(arg), buffer);
+      return !buffer.empty();
+   };
+   if ((... && ProcessArg(std::forward<Ts>(args))))
+      buffer = WriteAsText(segments.back(), buffer);
+   return buffer;
+}
+
 template <Formattable... Ts>
-std::span<char> Format(std::span<char> buffer, std::string_view fmt, Ts &&... args)
+std::span<char> Format(std::span<char> buffer, RuntimeString runtime, Ts &&... args)
 {
    using namespace internal;
-   assert(CountPlaceholders(fmt) == sizeof...(Ts));
+   std::string_view fmt = runtime.fmt;
    auto ProcessArg = [&](auto && arg) {
       std::tie(fmt, buffer) = CopyUntilPlaceholder(fmt, buffer);
       if (!buffer.empty())
@@ -0,0 +1,108 @@
+#ifndef FRAMEPOOL_HPP
+#define FRAMEPOOL_HPP
+
+#include <array>
+#include <cstddef>
+#include <new>
+
+namespace mem {
+
+// Thread-local cache of coroutine frame blocks in 64-byte size classes up to 1 KiB, bigger
+// frames go straight to the heap. A block freed on another thread than the one it came from
+// joins that thread's cache, every cache keeps at most MAX_CACHED blocks per size class.
+class FramePool
+{
+public:
+   static constexpr size_t GRANULE = 64;
+   static constexpr size_t CLASS_COUNT = 16;
+   static constexpr size_t MAX_CACHED = 64;
+
+   struct Stats
+   {
+      size_t allocations = 0;     // frames handed out on this thread
+      size_t heapAllocations = 0; // of which went to operator new
+   };
+
+   static void * Allocate(size_t size)
+   {
+      Cache & cache = Local();
+      ++cache.stats.allocations;
+      const size_t index = ClassIndex(size);
+      if (index < CLASS_COUNT) {
+         if (FreeBlock * block = cache.heads[index]) {
+            cache.heads[index] = block->next;
+            --cache.counts[index];
+            return block;
+         }
+         size = (index + 1U) * GRANULE;
+      }
+      ++cache.stats.heapAllocations;
+      return ::operator new(size);
+   }
+
+   // size must be the one given to Allocate()
+   static void Deallocate(void * ptr, size_t size) noexcept
+   {
+      Cache & cache = Local();
+      const size_t index = ClassIndex(size);
+      if (index >= CLASS_COUNT || cache.closed || cache.counts[index] == MAX_CACHED) {
+         ::operator delete(ptr);
+         return;
+      }
+      if (!cache.registered) {
+         thread_local Flusher s_flusher; // frees the cached blocks when the thread exits
+         cache.registered = true;
+      }
+      auto * block = static_cast<FreeBlock *>(ptr);
+      block->next = cache.heads[index];
+      cache.heads[index] = block;
+      ++cache.counts[index];
+   }
+
+   static Stats GetStats() noexcept { return Local().stats; }
+
+private:
+   struct FreeBlock
+   {
+      FreeBlock * next;
+   };
+   // trivially destructible, so that frames dying after the flusher can still tell
+   struct Cache
+   {
+      std::array<FreeBlock *, CLASS_COUNT> heads;
+      std::array<size_t, CLASS_COUNT> counts;
+      Stats stats;
+      bool registered;
+      bool closed;
+   };
+   struct Flusher
+   {
+      ~Flusher()
+      {
+         Cache & cache = Local();
+         cache.closed = true;
+         for (size_t i = 0; i < CLASS_COUNT; ++i) {
+            while (FreeBlock * block = cache.heads[i]) {
+               cache.heads[i] = block->next;
+               ::operator delete(block);
+            }
+            cache.counts[i] = 0;
+         }
+      }
+   };
+
+   static constexpr size_t ClassIndex(size_t size) noexcept
+   {
+      return size ? (size - 1U) / GRANULE : 0U;
+   }
+
+   static Cache & Local() noexcept
+   {
+      thread_local Cache s_cache{};
+      return s_cache;
+   }
+};
+
+} // namespace mem
+
+#endif // FRAMEPOOL_HPP
@@ -0,0 +1,109 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace stats {
+
+// Log-linear histogram: values below 2^SubBucketBits get a bucket each, every higher power of two
+// is split into 2^SubBucketBits equal sub-buckets. Values of 2^MaxBits and above share the last
+// bucket. Recording is lock-free and may race with taking a snapshot.
+template <size_t SubBucketBits = 2U, size_t MaxBits = 26U>
+class Histogram
+{
+   static_assert(SubBucketBits < MaxBits && MaxBits < 64U);
+
+public:
+   static constexpr size_t SUB_BUCKETS = size_t(1) << SubBucketBits;
+   static constexpr size_t BUCKET_COUNT = (MaxBits - SubBucketBits + 1U) * SUB_BUCKETS;
+
+   struct Snapshot
+   {
+      std::array<uint64_t, BUCKET_COUNT> buckets{};
+      uint64_t count = 0;
+      uint64_t sum = 0;
+      uint64_t max = 0;
+
+      // upper bound of the bucket holding the given percentile, 0 if empty
+      uint64_t Percentile(uint32_t percent) const noexcept
+      {
+         const uint64_t rank = (count * std::min(percent, 100U) + 99U) / 100U;
+         uint64_t seen = 0;
+         for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += buckets[i];
+            if (seen >= rank && seen > 0)
+               return i + 1 < BUCKET_COUNT ? std::min(LowerBound(i + 1) - 1, max) : max;
+         }
+         return 0;
+      }
+      uint64_t Mean() const noexcept { return count ? sum / count : 0; }
+   };
+
+   static constexpr size_t BucketIndex(uint64_t value) noexcept
+   {
+      if (value < SUB_BUCKETS)
+         return static_cast<size_t>(value);
+      const auto msb = static_cast<size_t>(std::bit_width(value)) - 1U;
+      if (msb >= MaxBits)
+         return BUCKET_COUNT - 1U;
+      const size_t shift = msb - SubBucketBits;
+      const auto sub = static_cast<size_t>(value >> shift) & (SUB_BUCKETS - 1U);
+      return (shift + 1U) * SUB_BUCKETS + sub;
+   }
+
+   static constexpr uint64_t LowerBound(size_t index) noexcept
+   {
+      if (index < SUB_BUCKETS)
+         return index;
+      const size_t shift = index / SUB_BUCKETS - 1U;
+      return static_cast<uint64_t>(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+   }
+
+   void Record(uint64_t value) noexcept
+   {
+      m_buckets[BucketIndex(value)].fetch_add(1U, std::memory_order_relaxed);
+      m_count.fetch_add(1U, std::memory_order_relaxed);
+      m_sum.fetch_add(value, std::memory_order_relaxed);
+      uint64_t max = m_max.load(std::memory_order_relaxed);
+      while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+         ;
+   }
+
+   uint64_t GetCount() const noexcept { return m_count.load(std::memory_order_relaxed); }
+
+   Snapshot GetSnapshot() const noexcept
+   {
+      Snapshot s;
+      for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+         s.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+         s.count += s.buckets[i];
+      }
+      s.sum = m_sum.load(std::memory_order_relaxed);
+      s.max = m_max.load(std::memory_order_relaxed);
+      return s;
+   }
+
+   void Reset() noexcept
+   {
+      for (auto & bucket : m_buckets)
+         bucket.store(0U, std::memory_order_relaxed);
+      m_count.store(0U, std::memory_order_relaxed);
+      m_sum.store(0U, std::memory_order_relaxed);
+      m_max.store(0U, std::memory_order_relaxed);
+   }
+
+private:
+   std::array<std::atomic<uint32_t>, BUCKET_COUNT> m_buckets{};
+   std::atomic<uint64_t> m_count{0};
+   std::atomic<uint64_t> m_sum{0};
+   std::atomic<uint64_t> m_max{0};
+};
+
+} // namespace stats
+
+#endif // HISTOGRAM_HPP
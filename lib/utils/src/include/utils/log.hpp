@@ -5,7 +5,13 @@
 
 #include <array>
 #include <concepts>
+#include <cstdint>
 #include <string_view>
+#include <type_traits>
+
+#ifndef VERIDIE_LOG_MIN_LEVEL
+#define VERIDIE_LOG_MIN_LEVEL 0 // debug
+#endif
 
 namespace internal {
 
@@ -16,6 +22,26 @@ concept NonEmpty = sizeof...(Ts) > 0;
 
 struct Log final
 {
+   enum class Level : uint8_t
+   {
+      DEBUG,
+      INFO,
+      WARNING,
+      ERROR,
+      FATAL,
+   };
+
+   // calls below MIN_COMPILED_LEVEL are compiled out, calls below s_level are dropped at run time
+   // before anything is formatted; Fatal is never dropped
+   static constexpr Level MIN_COMPILED_LEVEL = static_cast<Level>(VERIDIE_LOG_MIN_LEVEL);
+   static Level s_level;
+
+   static constexpr bool IsCompiledIn(Level level) noexcept { return level >= MIN_COMPILED_LEVEL; }
+
+   // a string literal whose placeholders match the arguments, fmt::Runtime() skips the check
+   template <typename... Ts>
+   using CheckedFormat = fmt::FormatString<std::type_identity_t<Ts>...>;
+
    static void Debug(const char * tag, const char * text);
    static void Info(const char * tag, const char * text);
    static void Warning(const char * tag, const char * text);
@@ -25,35 +51,35 @@ struct Log final
 
    // clang-format off
    template <typename... Ts> requires internal::NonEmpty<Ts...>
-   static void Debug(const char * tag, std::string_view fmt, Ts &&... args)
-   {
-      auto formatted = FormatArgs(fmt, std::forward<Ts>(args)...);
-      Debug(tag, std::data(formatted));
-   }
+   static void Debug(const char * tag, CheckedFormat<Ts...> fmt, Ts &&... args)
+   { Emit<Level::DEBUG>(tag, fmt, std::forward<Ts>(args)...); }
    template <typename... Ts> requires internal::NonEmpty<Ts...>
-   static void Info(const char * tag, std::string_view fmt, Ts &&... args)
-   {
-      auto formatted = FormatArgs(fmt, std::forward<Ts>(args)...);
-      Info(tag, std::data(formatted));
-   }
+   static void Debug(const char * tag, fmt::RuntimeString fmt, Ts &&... args)
+   { Emit<Level::DEBUG>(tag, fmt, std::forward<Ts>(args)...); }
    template <typename... Ts> requires internal::NonEmpty<Ts...>
-   static void Warning(const char * tag, std::string_view fmt, Ts &&... args)
-   {
-      auto formatted = FormatArgs(fmt, std::forward<Ts>(args)...);
-      Warning(tag, std::data(formatted));
-   }
+   static void Info(const char * tag, CheckedFormat<Ts...> fmt, Ts &&... args)
+   { Emit<Level::INFO>(tag, fmt, std::forward<Ts>(args)...); }
    template <typename... Ts> requires internal::NonEmpty<Ts...>
-   static void Error(const char * tag, std::string_view fmt, Ts &&... args)
-   {
-      auto formatted = FormatArgs(fmt, std::forward<Ts>(args)...);
-      Error(tag, std::data(formatted));
-   }
+   static void Info(const char * tag, fmt::RuntimeString fmt, Ts &&... args)
+   { Emit<Level::INFO>(tag, fmt, std::forward<Ts>(args)...); }
    template <typename... Ts> requires internal::NonEmpty<Ts...>
-   [[noreturn]] static void Fatal(const char * tag, std::string_view fmt, Ts &&... args)
-   {
-      auto formatted = FormatArgs(fmt, std::forward<Ts>(args)...);
-      Fatal(tag, std::data(formatted));
-   }
+   static void Warning(const char * tag, CheckedFormat<Ts...> fmt, Ts &&... args)
+   { Emit<Level::WARNING>(tag, fmt, std::forward<Ts>(args)...); }
+   template <typename... Ts> requires internal::NonEmpty<Ts...>
+   static void Warning(const char * tag, fmt::RuntimeString fmt, Ts &&... args)
+   { Emit<Level::WARNING>(tag, fmt, std::forward<Ts>(args)...); }
+   template <typename... Ts> requires internal::NonEmpty<Ts...>
+   static void Error(const char * tag, CheckedFormat<Ts...> fmt, Ts &&... args)
+   { Emit<Level::ERROR>(tag, fmt, std::forward<Ts>(args)...); }
+   template <typename... Ts> requires internal::NonEmpty<Ts...>
+   static void Error(const char * tag, fmt::RuntimeString fmt, Ts &&... args)
+   { Emit<Level::ERROR>(tag, fmt, std::forward<Ts>(args)...); }
+   template <typename... Ts> requires internal::NonEmpty<Ts...>
+   [[noreturn]] static void Fatal(const char * tag, CheckedFormat<Ts...> fmt, Ts &&... args)
+   { Fatal(tag, std::data(FormatArgs(fmt, std::forward<Ts>(args)...))); }
+   template <typename... Ts> requires internal::NonEmpty<Ts...>
+   [[noreturn]] static void Fatal(const char * tag, fmt::RuntimeString fmt, Ts &&... args)
+   { Fatal(tag, std::data(FormatArgs(fmt, std::forward<Ts>(args)...))); }
    // clang-format on
 
    using Handler = void (*)(const char *, const char *);
@@ -68,8 +94,27 @@ struct Log final
 private:
    static_assert((MAX_LINE_LENGTH + 1) % 64 == 0);
 
-   template <typename... Ts>
-   static auto FormatArgs(std::string_view fmt, Ts &&... args)
+   // formats and passes on to the plain overload for L, unless L is compiled out or filtered
+   template <Level L, typename F, typename... Ts>
+   static void Emit(const char * tag, F fmt, Ts &&... args)
+   {
+      if constexpr (IsCompiledIn(L)) {
+         if (s_level > L)
+            return;
+         auto formatted = FormatArgs(fmt, std::forward<Ts>(args)...);
+         if constexpr (L == Level::DEBUG)
+            Debug(tag, std::data(formatted));
+         else if constexpr (L == Level::INFO)
+            Info(tag, std::data(formatted));
+         else if constexpr (L == Level::WARNING)
+            Warning(tag, std::data(formatted));
+         else
+            Error(tag, std::data(formatted));
+      }
+   }
+
+   template <typename F, typename... Ts>
+   static auto FormatArgs(F fmt, Ts &&... args)
    {
       std::array<char, MAX_LINE_LENGTH + 1> buffer;
       auto rest = fmt::Format({buffer.data(), MAX_LINE_LENGTH}, fmt, std::forward<Ts>(args)...);
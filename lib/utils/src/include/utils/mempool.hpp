@@ -1,6 +1,7 @@
 #ifndef MEMPOOL_HPP
 #define MEMPOOL_HPP
 
+#include <array>
 #include <atomic>
 #include <cassert>
 #include <cstddef>
@@ -10,7 +11,28 @@
 #include <type_traits>
 #include "poolptr.hpp"
 
+#ifndef MEMPOOL_COLLECT_STATS
+#define MEMPOOL_COLLECT_STATS 1
+#endif
+
 namespace mem {
+
+struct SizeClassStats
+{
+   size_t blockSize = 0;
+   size_t blockCount = 0;
+   size_t liveBlocks = 0;
+   size_t highWaterMark = 0;
+   size_t misses = 0;      // allocations that found no free block and grew the list
+   size_t allocations = 0;
+   size_t probes = 0;      // blocks inspected while searching for a free one
+
+   double AverageSearchLength() const noexcept
+   {
+      return allocations ? static_cast<double>(probes) / static_cast<double>(allocations) : 0.0;
+   }
+};
+
 namespace internal {
 
 template <size_t N>
@@ -34,6 +56,40 @@ void * get_buffer(Block<N> & block) noexcept
    return &block.buffer;
 }
 
+struct Counters
+{
+   // live can be decremented from any thread since a PoolPtr may die anywhere
+   std::atomic<size_t> live{0U};
+   size_t highWaterMark = 0U;
+   size_t misses = 0U;
+   size_t allocations = 0U;
+   size_t probes = 0U;
+
+   void OnAllocated(size_t probed, bool missed) noexcept
+   {
+      if constexpr (MEMPOOL_COLLECT_STATS) {
+         const size_t nowLive = live.fetch_add(1U, std::memory_order_relaxed) + 1U;
+         if (nowLive > highWaterMark)
+            highWaterMark = nowLive;
+         misses += missed ? 1U : 0U;
+         ++allocations;
+         probes += probed;
+      }
+   }
+   void OnDeallocated() noexcept
+   {
+      if constexpr (MEMPOOL_COLLECT_STATS)
+         live.fetch_sub(1U, std::memory_order_relaxed);
+   }
+   void Reset() noexcept
+   {
+      highWaterMark = live.load(std::memory_order_relaxed);
+      misses = 0U;
+      allocations = 0U;
+      probes = 0U;
+   }
+};
+
 template <typename P, typename T, bool FITS>
 struct PoolFinder;
 
@@ -56,6 +112,7 @@ using SuitablePool = typename PoolFinder<P, T, (sizeof(T) <= P::BLOCK_SIZE)>::Ty
 
 // All methods in Pool must be called from the same thread, but a PoolPtr obtained through
 // Pool::Make can be marshalled to any other thread and die wherever it wants.
+// Usage statistics are collected per size class unless MEMPOOL_COLLECT_STATS is 0.
 
 template <size_t... Ss>
 class Pool;
@@ -71,6 +128,9 @@ public:
    using Myt = Pool<S, Ss...>;
    static_assert(BLOCK_SIZE < Base::BLOCK_SIZE, "Block sizes must be in ascending order");
 
+   static constexpr size_t SIZE_CLASS_COUNT = Base::SIZE_CLASS_COUNT + 1;
+   using Stats = std::array<SizeClassStats, SIZE_CLASS_COUNT>; // smallest block size first
+
    explicit Pool(size_t block_count)
       : Base(block_count)
       , m_blocks(block_count)
@@ -132,6 +192,19 @@ public:
 
    size_t GetSize() const noexcept { return Base::GetSize() + m_blocks.size() * BLOCK_SIZE; }
 
+   Stats GetStats() const noexcept
+   {
+      Stats ret{};
+      FillStats(ret.data());
+      return ret;
+   }
+
+   void ResetStats() noexcept
+   {
+      Base::ResetStats();
+      m_counters.Reset();
+   }
+
 protected:
    template <typename T, typename... TArgs>
    T * Allocate(TArgs &&... args)
@@ -139,15 +212,18 @@ protected:
       static_assert(alignof(T) <= alignof(std::max_align_t));
 
       T * ret = nullptr;
+      size_t probed = 0U;
 
       auto it = std::begin(m_blocks);
       for (; it != std::end(m_blocks); ++it) {
+         ++probed;
          if (!it->taken.test_and_set(std::memory_order_acquire)) {
             m_blocks.splice(std::cend(m_blocks), m_blocks, it); // move to the end
             break;
          }
       }
-      if (it == std::end(m_blocks)) {
+      const bool missed = it == std::end(m_blocks);
+      if (missed) {
          it = m_blocks.emplace(it);
          it->taken.test_and_set(std::memory_order_acquire);
       }
@@ -158,6 +234,7 @@ protected:
          it->taken.clear(std::memory_order_release);
          throw;
       }
+      m_counters.OnAllocated(probed, missed);
       return ret;
    }
    template <typename T>
@@ -170,10 +247,24 @@ protected:
       Block * b = internal::get_block<BLOCK_SIZE>(p);
       assert((void *)p == internal::get_buffer(*b));
       b->taken.clear(std::memory_order_release);
+      m_counters.OnDeallocated();
+   }
+
+   void FillStats(SizeClassStats * out) const noexcept
+   {
+      out->blockSize = BLOCK_SIZE;
+      out->blockCount = m_blocks.size();
+      out->liveBlocks = m_counters.live.load(std::memory_order_relaxed);
+      out->highWaterMark = m_counters.highWaterMark;
+      out->misses = m_counters.misses;
+      out->allocations = m_counters.allocations;
+      out->probes = m_counters.probes;
+      Base::FillStats(out + 1);
    }
 
 private:
    std::list<Block> m_blocks;
+   internal::Counters m_counters;
 };
 
 template <>
@@ -181,6 +272,7 @@ class Pool<>
 {
 public:
    static constexpr size_t BLOCK_SIZE = std::numeric_limits<size_t>::max();
+   static constexpr size_t SIZE_CLASS_COUNT = 0U;
 
 protected:
    explicit Pool(size_t) {}
@@ -206,6 +298,10 @@ protected:
    size_t GetBlockCount() const noexcept { return 0U; }
 
    size_t GetSize() const noexcept { return 0U; }
+
+   void ResetStats() noexcept {}
+
+   void FillStats(SizeClassStats *) const noexcept {}
 };
 
 } // namespace mem
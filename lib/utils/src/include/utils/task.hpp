@@ -2,6 +2,7 @@
 #define TASK_HPP
 
 #include "utils/coroutine.hpp"
+#include "utils/framepool.hpp"
 
 #include <concepts>
 #include <exception>
@@ -9,6 +10,11 @@
 #include <type_traits>
 #include <variant>
 
+// coroutine frames of TaskHandle and DetachedHandle come from mem::FramePool unless this is 0
+#ifndef CR_POOLED_FRAMES
+#define CR_POOLED_FRAMES 1
+#endif
+
 namespace cr {
 
 struct InlineExecutor
@@ -20,6 +26,24 @@ struct InlineExecutor
    }
 };
 
+namespace internal {
+
+// an inline executor resumes by symmetric transfer, so that long chains of tasks completing each
+// other run in constant stack space; g++ only turns the transfer into a tail call when optimizing,
+// so in -O0 builds the stack still grows with the chain
+template <typename E>
+stdcr::coroutine_handle<> Transfer(E & executor, stdcr::coroutine_handle<> h)
+{
+   if (!h)
+      return stdcr::noop_coroutine();
+   if constexpr (std::is_same_v<E, InlineExecutor>)
+      return h;
+   executor.Execute(h);
+   return stdcr::noop_coroutine();
+}
+
+} // namespace internal
+
 // clang-format off
 
 template <typename T>
@@ -58,6 +82,13 @@ concept Awaiter = requires(T && awaiter, stdcr::coroutine_handle<void> h) {
    requires internal::AwaitSuspendReturnType<decltype(awaiter.await_suspend(h))>;
 };
 
+// awaiter that can take back its pending resumption, Withdraw() returns true if the coroutine
+// will not be resumed by it anymore
+template <typename T>
+concept Withdrawable = requires(T & awaiter) {
+   { awaiter.Withdraw() } noexcept -> std::same_as<bool>;
+};
+
 template <typename E>
 concept Executor =
    std::is_default_constructible_v<E> &&
@@ -67,6 +98,12 @@ concept Executor =
       std::forward<E>(e).Execute(std::move(f));
    };
 
+// executors that never run two of their tasks at the same time because all of them run on the
+// thread that drives the executor, specialized by those that qualify
+template <typename E>
+struct RunsOnOneThread : std::is_same<E, InlineExecutor>
+{};
+
 
 namespace internal {
 
@@ -102,17 +139,38 @@ struct TaskHandle
 
    explicit operator bool() const noexcept;
    auto Run(E executor = {}, const bool * parentCanceled = nullptr);
+   // like Run() but the task starts only when the awaiting coroutine has suspended
+   auto Await(E executor = {}, const bool * parentCanceled = nullptr);
    void EnsureNoException();
+   // the exception the finished task ended with, if any, leaving none behind
+   std::exception_ptr TakeException() noexcept;
+   // instead of resuming an awaiting coroutine, the finished task calls hook(target), which may
+   // destroy it right away
+   void OnDone(void (*hook)(void *) noexcept, void * target) noexcept;
    void Swap(TaskHandle & other) noexcept;
 
 private:
+   struct Awaiter;
+   void Prepare(E executor, const bool * parentCanceled);
+
    handle_type m_handle;
 };
 
 
 namespace internal {
 
-struct DetachedPromise
+struct FrameAllocator
+{
+#if CR_POOLED_FRAMES
+   static void * operator new(size_t size) { return mem::FramePool::Allocate(size); }
+   static void operator delete(void * ptr, size_t size) noexcept
+   {
+      mem::FramePool::Deallocate(ptr, size);
+   }
+#endif
+};
+
+struct DetachedPromise : FrameAllocator
 {
    DetachedHandle get_return_object() const noexcept { return {}; }
    stdcr::suspend_never initial_suspend() const noexcept { return {}; }
@@ -127,7 +185,7 @@ struct DetachedPromise
    template <TaskResult T, Executor E>
    auto await_transform(TaskHandle<T, E> && handle)
    {
-      return handle.Run();
+      return handle.Await();
    }
 };
 
@@ -157,13 +215,26 @@ template <TaskResult T, Executor E>
 struct Promise
    : public ValueHolder<T>
    , public E
+   , public FrameAllocator
 {
    template <Awaiter A>
    struct CancelingAwaiter : A
    {
-      const Promise & p;
+      Promise & p;
+      template <typename H>
+      decltype(auto) await_suspend(H h)
+      {
+         if constexpr (Withdrawable<A>) {
+            p.withdraw = [](void * awaiter) noexcept {
+               return static_cast<A *>(awaiter)->Withdraw();
+            };
+            p.withdrawTarget = static_cast<A *>(this);
+         }
+         return A::await_suspend(h);
+      }
       decltype(auto) await_resume()
       {
+         p.withdraw = nullptr;
          if (p.canceled || (p.parentCanceled && *p.parentCanceled))
             throw CanceledException{};
          return A::await_resume();
@@ -173,6 +244,19 @@ struct Promise
    bool canceled = false;
    const bool * parentCanceled = nullptr;
    stdcr::coroutine_handle<> parentHandle = nullptr;
+   bool (*withdraw)(void *) noexcept = nullptr;
+   void * withdrawTarget = nullptr;
+   bool withdrawn = false;
+   void (*onDone)(void *) noexcept = nullptr;
+   void * onDoneTarget = nullptr;
+
+   // true once the coroutine is known not to be resumed again
+   bool Withdraw() noexcept
+   {
+      if (!withdrawn && withdraw && withdraw(withdrawTarget))
+         withdrawn = true;
+      return withdrawn;
+   }
 
    const E & Executor() const noexcept { return static_cast<const E &>(*this); }
    E & Executor() noexcept { return static_cast<E &>(*this); }
@@ -185,17 +269,17 @@ struct Promise
    }
 
    template <Awaiter A>
-   auto await_transform(A && awaiter) const
+   auto await_transform(A && awaiter)
    {
       return CancelingAwaiter<std::remove_reference_t<A>>{std::forward<A>(awaiter), *this};
    }
 
    template <TaskResult R>
-   auto await_transform(TaskHandle<R, E> && innerTask) const
+   auto await_transform(TaskHandle<R, E> && innerTask)
    {
-      using InnerAwaiter = std::remove_reference_t<decltype(innerTask.Run())>;
+      using InnerAwaiter = std::remove_reference_t<decltype(innerTask.Await())>;
       return CancelingAwaiter<InnerAwaiter>{
-         innerTask.Run(Executor(), parentCanceled ? parentCanceled : &canceled),
+         innerTask.Await(Executor(), parentCanceled ? parentCanceled : &canceled),
          *this};
    }
 
@@ -226,10 +310,13 @@ struct Promise
          Promise & p;
 
          bool await_ready() const noexcept { return p.canceled; }
-         void await_suspend(stdcr::coroutine_handle<>) noexcept
+         stdcr::coroutine_handle<> await_suspend(stdcr::coroutine_handle<>) noexcept
          {
-            if (p.parentHandle)
-               p.Execute(p.parentHandle);
+            if (p.onDone) {
+               p.onDone(p.onDoneTarget); // the frame may be gone after this
+               return stdcr::noop_coroutine();
+            }
+            return Transfer(p.Executor(), p.parentHandle);
          }
          void await_resume() const noexcept {}
       };
@@ -267,7 +354,11 @@ TaskHandle<T, E>::~TaskHandle()
       return;
    }
 
+   // destroy right away if nothing is going to resume us, otherwise CanceledException unwinds
+   // the coroutine once it is resumed
    m_handle.promise().canceled = true;
+   if (m_handle.promise().Withdraw())
+      m_handle.destroy();
 }
 
 template <TaskResult T, Executor E>
@@ -284,39 +375,77 @@ TaskHandle<T, E>::operator bool() const noexcept
 }
 
 template <TaskResult T, Executor E>
-auto TaskHandle<T, E>::Run(E executor, const bool * parentCanceled)
+struct TaskHandle<T, E>::Awaiter
+{
+   handle_type handle;
+   bool started;
+
+   bool await_ready() const noexcept { return started && handle.done(); }
+   stdcr::coroutine_handle<> await_suspend(stdcr::coroutine_handle<> h)
+   {
+      handle.promise().parentHandle = h;
+      if (started)
+         return stdcr::noop_coroutine();
+      started = true;
+      return internal::Transfer(handle.promise().Executor(), handle);
+   }
+   bool Withdraw() noexcept { return handle.promise().Withdraw(); }
+   T await_resume()
+   {
+      if (std::holds_alternative<std::exception_ptr>(handle.promise().value))
+         std::rethrow_exception(std::get<std::exception_ptr>(handle.promise().value));
+      return handle.promise().RetrieveValue();
+   }
+};
+
+template <TaskResult T, Executor E>
+void TaskHandle<T, E>::Prepare(E executor, const bool * parentCanceled)
 {
    m_handle.promise().Executor() = executor;
    m_handle.promise().parentCanceled = parentCanceled;
-   m_handle.promise().Executor().Execute(m_handle);
+}
 
-   struct Awaiter
-   {
-      handle_type handle;
+template <TaskResult T, Executor E>
+auto TaskHandle<T, E>::Run(E executor, const bool * parentCanceled)
+{
+   Prepare(executor, parentCanceled);
+   m_handle.promise().Executor().Execute(m_handle);
+   return Awaiter{m_handle, true};
+}
 
-      bool await_ready() const noexcept { return handle.done(); }
-      void await_suspend(stdcr::coroutine_handle<> h) { handle.promise().parentHandle = h; }
-      T await_resume()
-      {
-         if (std::holds_alternative<std::exception_ptr>(handle.promise().value))
-            std::rethrow_exception(std::get<std::exception_ptr>(handle.promise().value));
-         return handle.promise().RetrieveValue();
-      }
-   };
-   return Awaiter{m_handle};
+template <TaskResult T, Executor E>
+auto TaskHandle<T, E>::Await(E executor, const bool * parentCanceled)
+{
+   Prepare(executor, parentCanceled);
+   return Awaiter{m_handle, false};
 }
 
 template <TaskResult T, Executor E>
 void TaskHandle<T, E>::EnsureNoException()
+{
+   if (std::exception_ptr exptr = TakeException())
+      std::rethrow_exception(exptr);
+}
+
+template <TaskResult T, Executor E>
+std::exception_ptr TaskHandle<T, E>::TakeException() noexcept
 {
    if (!m_handle || !m_handle.done())
-      return;
+      return nullptr;
 
-   if (const auto * exptr = std::get_if<std::exception_ptr>(&m_handle.promise().value)) {
-      std::exception_ptr copy = *exptr;
+   if (auto * exptr = std::get_if<std::exception_ptr>(&m_handle.promise().value)) {
+      std::exception_ptr taken = std::move(*exptr);
       m_handle.promise().value.template emplace<std::monostate>();
-      std::rethrow_exception(copy);
+      return taken;
    }
+   return nullptr;
+}
+
+template <TaskResult T, Executor E>
+void TaskHandle<T, E>::OnDone(void (*hook)(void *) noexcept, void * target) noexcept
+{
+   m_handle.promise().onDone = hook;
+   m_handle.promise().onDoneTarget = target;
 }
 
 template <TaskResult T, Executor E>
@@ -3,10 +3,15 @@
 
 #include "utils/task.hpp"
 
-#include <vector>
+#include <deque>
+#include <exception>
+#include <utility>
 
 namespace cr {
 
+// Runs root tasks and cancels the unfinished ones when destroyed. A task gives its slot back
+// and is destroyed as soon as it finishes, the exception it ended with, if any, is kept until
+// RethrowExceptions() or the next StartRootTask().
 template <Executor E = InlineExecutor>
 class TaskOwner
 {
@@ -14,15 +19,16 @@ public:
    explicit TaskOwner(E executor = {})
       : m_executor(executor)
    {}
+   TaskOwner(const TaskOwner &) = delete;
+   TaskOwner & operator=(const TaskOwner &) = delete;
 
    void StartRootTask(TaskHandle<void, E> && task)
    {
       RethrowExceptions();
-      std::erase_if(m_tasks, [](const TaskHandle<void, E> & t) {
-         return !t;
-      });
-      m_tasks.emplace_back(std::move(task));
-      m_tasks.back().Run(m_executor);
+      Slot & slot = AcquireSlot();
+      slot.task = std::move(task);
+      slot.task.OnDone(&TaskOwner::OnTaskDone, &slot);
+      slot.task.Run(m_executor);
    }
 
    [[nodiscard]] auto StartNestedTask(TaskHandle<void, E> && task)
@@ -45,15 +51,46 @@ public:
 
    void RethrowExceptions()
    {
-      for (auto & task : m_tasks)
-         task.EnsureNoException();
+      if (m_exceptions.empty())
+         return;
+      std::exception_ptr first = std::move(m_exceptions.front());
+      m_exceptions.pop_front();
+      std::rethrow_exception(first);
    }
 
    E Executor() const { return m_executor; }
 
 private:
+   struct Slot
+   {
+      TaskOwner * owner;
+      TaskHandle<void, E> task;
+      Slot * nextFree = nullptr;
+   };
+
+   Slot & AcquireSlot()
+   {
+      if (Slot * slot = m_freeSlots) {
+         m_freeSlots = slot->nextFree;
+         return *slot;
+      }
+      return m_slots.emplace_back(Slot{this, {}, nullptr});
+   }
+
+   static void OnTaskDone(void * target) noexcept
+   {
+      Slot & slot = *static_cast<Slot *>(target);
+      TaskOwner & owner = *slot.owner;
+      if (std::exception_ptr exptr = slot.task.TakeException())
+         owner.m_exceptions.push_back(std::move(exptr));
+      slot.task = {};
+      slot.nextFree = std::exchange(owner.m_freeSlots, &slot);
+   }
+
    E m_executor;
-   std::vector<TaskHandle<void, E>> m_tasks;
+   std::deque<std::exception_ptr> m_exceptions;
+   Slot * m_freeSlots = nullptr;
+   std::deque<Slot> m_slots; // a deque so that slots never move, tasks point to theirs
 };
 
 } // namespace cr
@@ -4,26 +4,110 @@
 #include "utils/task.hpp"
 
 #include <array>
+#include <cstddef>
 #include <optional>
+#include <stdexcept>
 #include <tuple>
+#include <utility>
+#include <vector>
 
 namespace cr {
 
 namespace internal {
 
-struct CurrentHandleRetriever
+// promise of the awaiting task, to start children on its executor
+template <typename P>
+struct PromiseRetriever
 {
-   stdcr::coroutine_handle<> handle;
+   P * promise = nullptr;
 
    bool await_ready() const noexcept { return false; }
    bool await_suspend(stdcr::coroutine_handle<> h) noexcept
    {
-      handle = h;
+      promise = &stdcr::coroutine_handle<P>::from_address(h.address()).promise();
       return false;
    }
-   stdcr::coroutine_handle<> await_resume() const noexcept { return handle; }
+   P & await_resume() const noexcept { return *promise; }
+};
+
+// starts a task on the parent's executor without waiting for it. It gets its own cancellation
+// flag rather than the parent's, the parent owns its handle and cancels it by dropping it.
+template <typename P, TaskResult R, Executor E>
+auto RunChild(P & parent, TaskHandle<R, E> & task)
+{
+   return task.Run(parent.Executor());
+}
+
+// resumes the given coroutine by symmetric transfer and stays suspended until destroyed
+struct TransferTo
+{
+   stdcr::coroutine_handle<> handle;
+
+   bool await_ready() const noexcept { return !handle; }
+   stdcr::coroutine_handle<> await_suspend(stdcr::coroutine_handle<>) const noexcept
+   {
+      return handle;
+   }
+   void await_resume() const noexcept {}
+   bool Withdraw() noexcept { return true; }
 };
 
+// suspends until a child task resumes us, the children die with the frame so nobody else will
+struct AwaitChild
+{
+   bool await_ready() const noexcept { return false; }
+   void await_suspend(stdcr::coroutine_handle<>) const noexcept {}
+   void await_resume() const noexcept {}
+   bool Withdraw() noexcept { return true; }
+};
+
+template <TaskResult R>
+struct AllResult
+{
+   using Type = std::vector<R>;
+};
+
+template <>
+struct AllResult<void>
+{
+   using Type = void;
+};
+
+template <TaskResult R>
+struct AnyResult
+{
+   using Type = std::pair<size_t, R>; // index of the first task to finish and its result
+};
+
+template <>
+struct AnyResult<void>
+{
+   using Type = size_t;
+};
+
+// starts all tasks, then makes those still running resume the given coroutine when they finish,
+// so that tasks finishing right away never resume a coroutine that is not suspended yet. That
+// only holds if no task can run before the coroutine suspends, i.e. on one thread.
+template <typename P, Executor E, TaskResult R>
+auto StartAll(P & parent, std::vector<TaskHandle<R, E>> & tasks)
+{
+   static_assert(RunsOnOneThread<E>::value,
+                 "a task on another thread could finish before its parent is set or suspended");
+   using Awaiter = decltype(tasks.front().Run());
+   std::vector<Awaiter> awaiters;
+   awaiters.reserve(tasks.size());
+   for (auto & task : tasks)
+      awaiters.push_back(RunChild(parent, task));
+   size_t running = 0;
+   for (auto & awaiter : awaiters) {
+      if (!awaiter.await_ready()) {
+         awaiter.await_suspend(stdcr::coroutine_handle<P>::from_promise(parent));
+         ++running;
+      }
+   }
+   return std::pair(std::move(awaiters), running);
+}
+
 template <typename F, typename T, size_t... Is>
 auto CreateArray(std::index_sequence<Is...>, T && tuple, F && transform)
 {
@@ -57,9 +141,14 @@ struct NonVoid<C<Ts...>>
 template <typename T>
 using NonVoid = typename internal::NonVoid<T>::Type;
 
+// Completes with the first of the tasks to finish. The others are canceled right away: their
+// frames are destroyed before AnyOf() returns, or when they are next resumed if they were waiting
+// for something that cannot be withdrawn.
 template <Executor E, TaskResult... Rs>
 TaskHandle<NonVoid<std::variant<Rs...>>, E> AnyOf(TaskHandle<Rs, E>... ts)
 {
+   using Promise = typename TaskHandle<NonVoid<std::variant<Rs...>>, E>::promise_type;
+   auto & promise = co_await internal::PromiseRetriever<Promise>{};
    std::optional<NonVoid<std::variant<Rs...>>> ret;
    stdcr::coroutine_handle<> thisHandle = nullptr;
 
@@ -75,8 +164,7 @@ TaskHandle<NonVoid<std::variant<Rs...>>, E> AnyOf(TaskHandle<Rs, E>... ts)
          R tmp = co_await std::move(task);
          ret.emplace(i, std::move(tmp));
       }
-      if (thisHandle)
-         thisHandle.resume();
+      co_await internal::TransferTo{thisHandle};
    };
 
    auto handles = internal::CreateArray(std::make_index_sequence<sizeof...(Rs)>{},
@@ -84,14 +172,72 @@ TaskHandle<NonVoid<std::variant<Rs...>>, E> AnyOf(TaskHandle<Rs, E>... ts)
                                         TaskWrapper);
 
    for (auto & h : handles)
-      h.Run();
+      internal::RunChild(promise, h);
 
    if (!ret.has_value()) {
-      thisHandle = co_await internal::CurrentHandleRetriever{};
-      co_await stdcr::suspend_always{};
+      thisHandle = stdcr::coroutine_handle<Promise>::from_promise(promise);
+      co_await internal::AwaitChild{};
    }
 
-   co_return *ret;
+   // the winner is parked in TransferTo, the losers are canceled
+   for (auto & h : handles)
+      h = {};
+   co_return std::move(*ret);
+}
+
+// Runs all tasks concurrently and completes when every one of them has, with their results in
+// the order of the tasks. If any fail, the exception of the first failed one in that order is
+// rethrown once all are done. Only for executors that run on one thread, see RunsOnOneThread,
+// and the tasks must be resumed on that thread too.
+template <Executor E, TaskResult R>
+TaskHandle<typename internal::AllResult<R>::Type, E> WhenAll(std::vector<TaskHandle<R, E>> tasks)
+{
+   using Promise = typename TaskHandle<typename internal::AllResult<R>::Type, E>::promise_type;
+   auto & promise = co_await internal::PromiseRetriever<Promise>{};
+   auto [awaiters, running] = internal::StartAll(promise, tasks);
+   for (; running > 0; --running)
+      co_await internal::AwaitChild{};
+
+   if constexpr (std::is_same_v<R, void>) {
+      for (auto & awaiter : awaiters)
+         awaiter.await_resume();
+   } else {
+      std::vector<R> results;
+      results.reserve(awaiters.size());
+      for (auto & awaiter : awaiters)
+         results.push_back(awaiter.await_resume());
+      co_return results;
+   }
+}
+
+// Runs all tasks concurrently and completes with the first one to finish. The others are
+// canceled like in AnyOf(). The same threading rules as for WhenAll() apply.
+template <Executor E, TaskResult R>
+TaskHandle<typename internal::AnyResult<R>::Type, E> WhenAny(std::vector<TaskHandle<R, E>> tasks)
+{
+   if (tasks.empty())
+      throw std::invalid_argument("WhenAny() needs at least one task");
+
+   using Promise = typename TaskHandle<typename internal::AnyResult<R>::Type, E>::promise_type;
+   auto & promise = co_await internal::PromiseRetriever<Promise>{};
+   auto [awaiters, running] = internal::StartAll(promise, tasks);
+   if (running == awaiters.size())
+      co_await internal::AwaitChild{};
+
+   size_t winner = 0;
+   while (!awaiters[winner].await_ready())
+      ++winner;
+   for (size_t i = 0; i < tasks.size(); ++i) {
+      if (i != winner)
+         tasks[i] = {};
+   }
+
+   if constexpr (std::is_same_v<R, void>) {
+      awaiters[winner].await_resume();
+      co_return winner;
+   } else {
+      co_return std::pair<size_t, R>(winner, awaiters[winner].await_resume());
+   }
 }
 
 } // namespace cr
@@ -0,0 +1,131 @@
+#ifndef UNIQUE_FUNCTION_HPP
+#define UNIQUE_FUNCTION_HPP
+
+#include "utils/coroutine.hpp"
+
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature>
+class UniqueFunction;
+
+// Move-only replacement for std::function. Callables up to INLINE_SIZE bytes are stored in place,
+// trivially copyable ones (e.g. coroutine handles) are also moved and destroyed without indirect
+// calls. Anything bigger goes to the heap.
+template <typename R, typename... Args>
+class UniqueFunction<R(Args...)>
+{
+public:
+   static constexpr size_t INLINE_SIZE = 6 * sizeof(void *);
+
+   template <typename F>
+   static constexpr bool IS_INLINE = sizeof(F) <= INLINE_SIZE &&
+                                     alignof(F) <= alignof(std::max_align_t) &&
+                                     std::is_nothrow_move_constructible_v<F>;
+
+   UniqueFunction() noexcept = default;
+   UniqueFunction(std::nullptr_t) noexcept {}
+
+   template <typename F>
+      requires(!std::same_as<std::remove_cvref_t<F>, UniqueFunction> &&
+               std::is_invocable_r_v<R, std::decay_t<F> &, Args...>)
+   UniqueFunction(F && f)
+   {
+      using Fn = std::decay_t<F>;
+      if constexpr (IS_INLINE<Fn>) {
+         ::new (static_cast<void *>(m_storage)) Fn(std::forward<F>(f));
+         m_invoke = [](void * storage, Args &&... args) -> R {
+            return std::invoke(*std::launder(static_cast<Fn *>(storage)),
+                               std::forward<Args>(args)...);
+         };
+         if constexpr (!std::is_trivially_copyable_v<Fn>) {
+            m_manage = [](void * src, void * dst) noexcept {
+               auto * fn = std::launder(static_cast<Fn *>(src));
+               if (dst)
+                  ::new (dst) Fn(std::move(*fn));
+               fn->~Fn();
+            };
+         }
+      } else {
+         *reinterpret_cast<Fn **>(m_storage) = new Fn(std::forward<F>(f));
+         m_invoke = [](void * storage, Args &&... args) -> R {
+            return std::invoke(**static_cast<Fn **>(storage), std::forward<Args>(args)...);
+         };
+         m_manage = [](void * src, void * dst) noexcept {
+            if (dst)
+               *static_cast<Fn **>(dst) = *static_cast<Fn **>(src);
+            else
+               delete *static_cast<Fn **>(src);
+         };
+      }
+   }
+
+   // no wrapper needed to resume a coroutine
+   UniqueFunction(stdcr::coroutine_handle<> h) noexcept
+      requires std::is_void_v<R> && (sizeof...(Args) == 0)
+   {
+      ::new (static_cast<void *>(m_storage)) stdcr::coroutine_handle<>(h);
+      m_invoke = [](void * storage) {
+         std::launder(static_cast<stdcr::coroutine_handle<> *>(storage))->resume();
+      };
+   }
+
+   UniqueFunction(UniqueFunction && other) noexcept { MoveFrom(other); }
+
+   UniqueFunction & operator=(UniqueFunction && other) noexcept
+   {
+      if (this != &other) {
+         Reset();
+         MoveFrom(other);
+      }
+      return *this;
+   }
+
+   UniqueFunction & operator=(std::nullptr_t) noexcept
+   {
+      Reset();
+      return *this;
+   }
+
+   ~UniqueFunction() { Reset(); }
+
+   explicit operator bool() const noexcept { return m_invoke != nullptr; }
+
+   R operator()(Args... args) { return m_invoke(m_storage, std::forward<Args>(args)...); }
+
+private:
+   using Invoke = R (*)(void *, Args &&...);
+   // moves the callable from src to dst and destroys the source, only destroys if dst is null
+   using Manage = void (*)(void * src, void * dst) noexcept;
+
+   void MoveFrom(UniqueFunction & other) noexcept
+   {
+      if (!other.m_invoke)
+         return;
+      if (other.m_manage)
+         other.m_manage(other.m_storage, m_storage);
+      else
+         std::memcpy(m_storage, other.m_storage, INLINE_SIZE);
+      m_invoke = std::exchange(other.m_invoke, nullptr);
+      m_manage = std::exchange(other.m_manage, nullptr);
+   }
+
+   void Reset() noexcept
+   {
+      if (m_manage)
+         m_manage(m_storage, nullptr);
+      m_invoke = nullptr;
+      m_manage = nullptr;
+   }
+
+   alignas(std::max_align_t) std::byte m_storage[INLINE_SIZE];
+   Invoke m_invoke = nullptr;
+   Manage m_manage = nullptr;
+};
+
+#endif // UNIQUE_FUNCTION_HPP
@@ -0,0 +1,130 @@
+#ifndef VIRTUAL_SCHEDULER_HPP
+#define VIRTUAL_SCHEDULER_HPP
+
+#include "utils/task.hpp"
+#include "utils/uniquefunction.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+namespace cr {
+
+// Single-threaded scheduler with a virtual clock that jumps straight to the next deadline, for
+// running long timer-driven scenarios in tests and benchmarks without sleeping. Tasks run in
+// deadline order and those due at the same time in scheduling order, so every run is the same.
+// Tasks run on the thread that drives the scheduler, their exceptions propagate to it.
+class VirtualScheduler
+{
+public:
+   using Task = UniqueFunction<void()>;
+   using TimerId = uint64_t;
+   static constexpr TimerId NO_TIMER = 0;
+
+   // cr::Executor that queues tasks to run at the current virtual time
+   struct Executor
+   {
+      VirtualScheduler * scheduler = nullptr;
+
+      template <typename F>
+      void Execute(F && f) const
+      {
+         scheduler->Schedule(std::forward<F>(f), std::chrono::milliseconds(0));
+      }
+   };
+
+   // virtual time since construction
+   std::chrono::milliseconds Now() const noexcept { return m_now; }
+   size_t PendingCount() const noexcept { return m_tasks.size(); }
+   Executor GetExecutor() noexcept { return {this}; }
+
+   // can be passed to core::Timer as its scheduler, negative delays count as zero
+   TimerId Schedule(Task && task, std::chrono::milliseconds delay)
+   {
+      const Key key{m_now + std::max(delay, std::chrono::milliseconds(0)), ++m_lastId};
+      m_tasks.emplace(key, std::move(task));
+      m_deadlines.emplace(key.id, key.deadline);
+      return key.id;
+   }
+
+   // and as its canceller, false if the task has already run or been cancelled
+   bool Cancel(TimerId id)
+   {
+      const auto it = m_deadlines.find(id);
+      if (it == std::end(m_deadlines))
+         return false;
+      m_tasks.erase(Key{it->second, id});
+      m_deadlines.erase(it);
+      return true;
+   }
+
+   // runs the earliest task, moving the clock forward to its deadline if needed
+   bool RunNext()
+   {
+      if (m_tasks.empty())
+         return false;
+      auto node = m_tasks.extract(std::begin(m_tasks));
+      m_deadlines.erase(node.key().id);
+      m_now = std::max(m_now, node.key().deadline);
+      node.mapped()();
+      return true;
+   }
+
+   // runs everything due up to the given time, then sets the clock to it
+   size_t RunUntil(std::chrono::milliseconds time)
+   {
+      size_t count = 0;
+      while (!m_tasks.empty() && std::begin(m_tasks)->first.deadline <= time) {
+         RunNext();
+         ++count;
+      }
+      m_now = std::max(m_now, time);
+      return count;
+   }
+
+   size_t RunFor(std::chrono::milliseconds duration) { return RunUntil(m_now + duration); }
+
+   // runs what is due now, without moving the clock
+   size_t RunReady() { return RunUntil(m_now); }
+
+   // runs until no tasks are left, or the limit is reached in case tasks keep rescheduling
+   size_t RunUntilIdle(size_t maxTasks = std::numeric_limits<size_t>::max())
+   {
+      size_t count = 0;
+      while (count < maxTasks && RunNext())
+         ++count;
+      return count;
+   }
+
+private:
+   struct Key
+   {
+      std::chrono::milliseconds deadline;
+      TimerId id;
+
+      bool operator<(const Key & other) const noexcept
+      {
+         return std::pair(deadline, id) < std::pair(other.deadline, other.id);
+      }
+   };
+
+   std::chrono::milliseconds m_now{0};
+   TimerId m_lastId = NO_TIMER;
+   std::map<Key, Task> m_tasks;
+   std::unordered_map<TimerId, std::chrono::milliseconds> m_deadlines;
+};
+static_assert(Executor<VirtualScheduler::Executor>);
+
+template <>
+struct RunsOnOneThread<VirtualScheduler::Executor> : std::true_type
+{};
+
+} // namespace cr
+
+#endif // VIRTUAL_SCHEDULER_HPP
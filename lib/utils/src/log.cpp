@@ -19,6 +19,7 @@ void StdLog(FILE * file, char what, const char * tag, const char * text)
 } // namespace
 
 
+Log::Level Log::s_level = Log::Level::DEBUG;
 Log::Handler Log::s_debugHandler = nullptr;
 Log::Handler Log::s_infoHandler = nullptr;
 Log::Handler Log::s_warningHandler = nullptr;
@@ -27,6 +28,8 @@ Log::Handler Log::s_fatalHandler = nullptr;
 
 void Log::Debug(const char * tag, const char * text)
 {
+   if (!IsCompiledIn(Level::DEBUG) || s_level > Level::DEBUG)
+      return;
    if (s_debugHandler)
       s_debugHandler(tag, text);
    else
@@ -35,6 +38,8 @@ void Log::Debug(const char * tag, const char * text)
 
 void Log::Info(const char * tag, const char * text)
 {
+   if (!IsCompiledIn(Level::INFO) || s_level > Level::INFO)
+      return;
    if (s_infoHandler)
       s_infoHandler(tag, text);
    else
@@ -43,6 +48,8 @@ void Log::Info(const char * tag, const char * text)
 
 void Log::Warning(const char * tag, const char * text)
 {
+   if (!IsCompiledIn(Level::WARNING) || s_level > Level::WARNING)
+      return;
    if (s_warningHandler)
       s_warningHandler(tag, text);
    else
@@ -51,6 +58,8 @@ void Log::Warning(const char * tag, const char * text)
 
 void Log::Error(const char * tag, const char * text)
 {
+   if (!IsCompiledIn(Level::ERROR) || s_level > Level::ERROR)
+      return;
    if (s_errorHandler)
       s_errorHandler(tag, text);
    else
@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+#include "utils/asyncgenerator.hpp"
+#include "utils/task.hpp"
+#include "utils/taskowner.hpp"
+
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct State
+{
+   stdcr::coroutine_handle<> handle = nullptr;
+};
+
+struct Awaitable
+{
+   State & state;
+   bool await_ready() { return false; }
+   void await_suspend(stdcr::coroutine_handle<> h) { state.handle = h; }
+   void await_resume() {}
+};
+
+struct WithdrawableAwaitable : Awaitable
+{
+   bool Withdraw() noexcept { return true; }
+};
+
+struct Counter
+{
+   int & count;
+
+   explicit Counter(int & counter)
+      : count(counter)
+   {
+      ++count;
+   }
+   ~Counter() { --count; }
+};
+
+TEST(AsyncGeneratorTest, produces_elements_only_when_asked)
+{
+   std::vector<int> produced;
+   static auto Numbers = [](std::vector<int> & produced, int count) -> cr::AsyncGenerator<int> {
+      for (int i = 0; i < count; ++i) {
+         produced.push_back(i);
+         co_yield i;
+      }
+   };
+
+   std::vector<int> consumed;
+   State consumerState;
+   auto Consumer = [&]() -> cr::TaskHandle<void> {
+      auto numbers = Numbers(produced, 3);
+      while (auto number = co_await numbers.Next()) {
+         consumed.push_back(*number);
+         co_await Awaitable{consumerState};
+      }
+   };
+
+   auto task = Consumer();
+   task.Run();
+   EXPECT_EQ(std::vector<int>{0}, produced);
+   EXPECT_EQ(std::vector<int>{0}, consumed);
+
+   consumerState.handle.resume();
+   EXPECT_EQ((std::vector<int>{0, 1}), produced);
+   EXPECT_EQ((std::vector<int>{0, 1}), consumed);
+
+   consumerState.handle.resume();
+   consumerState.handle.resume();
+   EXPECT_EQ((std::vector<int>{0, 1, 2}), consumed);
+   EXPECT_FALSE(task);
+}
+
+TEST(AsyncGeneratorTest, body_can_await_between_elements)
+{
+   State producerState;
+   static auto Chunks = [](State & s) -> cr::AsyncGenerator<std::string> {
+      co_yield "first";
+      co_await Awaitable{s};
+      co_yield "second";
+   };
+
+   std::vector<std::string> consumed;
+   auto Consumer = [&]() -> cr::TaskHandle<void> {
+      auto chunks = Chunks(producerState);
+      while (auto chunk = co_await chunks.Next())
+         consumed.push_back(std::move(*chunk));
+   };
+
+   auto task = Consumer();
+   task.Run();
+   EXPECT_EQ(std::vector<std::string>{"first"}, consumed);
+   ASSERT_TRUE(producerState.handle);
+
+   producerState.handle.resume();
+   EXPECT_EQ((std::vector<std::string>{"first", "second"}), consumed);
+   EXPECT_FALSE(task);
+}
+
+TEST(AsyncGeneratorTest, exception_in_body_reaches_consumer)
+{
+   static auto Failing = []() -> cr::AsyncGenerator<int> {
+      co_yield 1;
+      throw std::runtime_error("oops");
+   };
+
+   std::vector<int> consumed;
+   std::optional<std::string> error;
+   auto Consumer = [&]() -> cr::TaskHandle<void> {
+      auto numbers = Failing();
+      try {
+         while (auto number = co_await numbers.Next())
+            consumed.push_back(*number);
+      } catch (const std::exception & e) {
+         error.emplace(e.what());
+      }
+   };
+
+   auto task = Consumer();
+   task.Run();
+   EXPECT_EQ(std::vector<int>{1}, consumed);
+   EXPECT_EQ("oops", error);
+}
+
+TEST(AsyncGeneratorTest, sequence_ends_after_the_exception)
+{
+   static auto Failing = []() -> cr::AsyncGenerator<int> {
+      throw std::runtime_error("oops");
+      co_return;
+   };
+
+   std::optional<std::string> error;
+   bool endedAfterError = false;
+   auto Consumer = [&]() -> cr::TaskHandle<void> {
+      auto numbers = Failing();
+      try {
+         co_await numbers.Next();
+      } catch (const std::exception & e) {
+         error.emplace(e.what());
+      }
+      endedAfterError = !(co_await numbers.Next());
+   };
+
+   auto task = Consumer();
+   task.Run();
+   EXPECT_EQ("oops", error);
+   EXPECT_TRUE(endedAfterError);
+   EXPECT_FALSE(task);
+}
+
+TEST(AsyncGeneratorTest, task_owner_cancels_generator_with_its_consumer)
+{
+   int liveFrames = 0;
+   State producerState;
+   State consumerState;
+   static auto Slow = [](int & frames, State & s) -> cr::AsyncGenerator<int> {
+      Counter c(frames);
+      for (int i = 0;; ++i) {
+         co_await WithdrawableAwaitable{s};
+         co_yield i;
+      }
+   };
+
+   std::vector<int> consumed;
+   auto Consumer = [&]() -> cr::TaskHandle<void> {
+      Counter c(liveFrames);
+      auto numbers = Slow(liveFrames, producerState);
+      while (auto number = co_await numbers.Next()) {
+         consumed.push_back(*number);
+         co_await WithdrawableAwaitable{consumerState};
+      }
+   };
+
+   // canceled while parked at co_yield
+   {
+      cr::TaskOwner<> owner;
+      owner.StartRootTask(Consumer());
+      producerState.handle.resume();
+      EXPECT_EQ(std::vector<int>{0}, consumed);
+      EXPECT_EQ(2, liveFrames);
+   }
+   EXPECT_EQ(0, liveFrames);
+
+   // canceled while producing
+   {
+      cr::TaskOwner<> owner;
+      owner.StartRootTask(Consumer());
+      EXPECT_EQ(2, liveFrames);
+   }
+   EXPECT_EQ(0, liveFrames);
+}
+
+TEST(AsyncGeneratorTest, unstarted_generator_is_destroyed_without_running)
+{
+   bool ran = false;
+   static auto Numbers = [](std::shared_ptr<int> /*owned by the frame*/,
+                            bool & ran) -> cr::AsyncGenerator<int> {
+      ran = true;
+      co_yield 1;
+   };
+
+   auto token = std::make_shared<int>(0);
+   {
+      auto numbers = Numbers(token, ran);
+      EXPECT_EQ(2, token.use_count());
+   }
+   EXPECT_FALSE(ran);
+   EXPECT_EQ(1, token.use_count());
+}
+
+} // namespace
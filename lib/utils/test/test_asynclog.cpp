@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+
+#include "utils/asynclog.hpp"
+#include "utils/log.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct AsyncLogFixture : public ::testing::Test
+{
+   struct LogLine
+   {
+      char level;
+      std::string tag;
+      std::string text;
+      std::thread::id thread;
+   };
+   static inline std::mutex mutex;
+   static inline std::vector<LogLine> lines;
+   static inline std::chrono::milliseconds handlerDelay{0};
+
+   template <char L>
+   static void Record(const char * tag, const char * text)
+   {
+      std::this_thread::sleep_for(handlerDelay);
+      std::lock_guard lock(mutex);
+      lines.push_back(LogLine{L, tag, text, std::this_thread::get_id()});
+   }
+
+   AsyncLogFixture()
+   {
+      Log::s_debugHandler = &Record<'D'>;
+      Log::s_infoHandler = &Record<'I'>;
+      Log::s_warningHandler = &Record<'W'>;
+      Log::s_errorHandler = &Record<'E'>;
+      Log::s_fatalHandler = nullptr;
+      lines.clear();
+      handlerDelay = std::chrono::milliseconds(0);
+   }
+   ~AsyncLogFixture()
+   {
+      Log::s_debugHandler = nullptr;
+      Log::s_infoHandler = nullptr;
+      Log::s_warningHandler = nullptr;
+      Log::s_errorHandler = nullptr;
+   }
+};
+
+TEST_F(AsyncLogFixture, lines_reach_previous_handlers_on_another_thread_in_order)
+{
+   constexpr int THREADS = 4;
+   constexpr int LINES = 500;
+   {
+      AsyncLogSink sink({.capacity = 64, .overflow = AsyncLogSink::Overflow::BLOCK});
+      std::vector<std::thread> threads;
+      for (int t = 0; t < THREADS; ++t) {
+         threads.emplace_back([t] {
+            const std::string tag = "T" + std::to_string(t);
+            for (int i = 0; i < LINES; ++i)
+               Log::Info(tag.c_str(), "{}", i);
+         });
+      }
+      for (auto & thread : threads)
+         thread.join();
+      Log::Warning("Main", "last");
+      sink.Flush();
+      EXPECT_EQ(THREADS * LINES + 1, lines.size());
+      EXPECT_EQ(0U, sink.GetDroppedCount());
+   }
+   EXPECT_EQ("last", lines.back().text);
+   EXPECT_EQ('W', lines.back().level);
+
+   std::vector<int> next(THREADS, 0);
+   for (const auto & line : lines) {
+      EXPECT_NE(std::this_thread::get_id(), line.thread);
+      if (line.tag == "Main")
+         continue;
+      const int t = std::stoi(line.tag.substr(1));
+      EXPECT_EQ('I', line.level);
+      EXPECT_EQ(std::to_string(next[t]++), line.text);
+   }
+   EXPECT_EQ(std::vector<int>(THREADS, LINES), next);
+}
+
+TEST_F(AsyncLogFixture, restores_previous_handlers_when_destroyed)
+{
+   {
+      AsyncLogSink sink({});
+      EXPECT_NE(&Record<'E'>, Log::s_errorHandler);
+   }
+   EXPECT_EQ(&Record<'E'>, Log::s_errorHandler);
+   Log::Error("Tag", "sync");
+   ASSERT_EQ(1U, lines.size());
+   EXPECT_EQ(std::this_thread::get_id(), lines[0].thread);
+}
+
+TEST_F(AsyncLogFixture, full_queue_drops_and_reports_lines)
+{
+   handlerDelay = std::chrono::milliseconds(20);
+   {
+      AsyncLogSink sink({.capacity = 4, .overflow = AsyncLogSink::Overflow::DROP});
+      for (int i = 0; i < 50; ++i)
+         Log::Debug("Tag", "{}", i);
+      EXPECT_LT(0U, sink.GetDroppedCount());
+      handlerDelay = std::chrono::milliseconds(0);
+      sink.Flush();
+      Log::Debug("Tag", "after");
+      sink.Flush();
+
+      EXPECT_EQ(51U, lines.size() - 1U + sink.GetDroppedCount());
+      EXPECT_EQ("after", lines.back().text);
+      const auto report = std::find_if(lines.begin(), lines.end(), [](const LogLine & line) {
+         return line.level == 'W';
+      });
+      ASSERT_NE(lines.end(), report);
+      EXPECT_EQ("AsyncLog", report->tag);
+      EXPECT_EQ(std::to_string(sink.GetDroppedCount()) + " log line(s) dropped", report->text);
+   }
+}
+
+TEST_F(AsyncLogFixture, full_queue_blocks_without_losing_lines)
+{
+   handlerDelay = std::chrono::milliseconds(1);
+   AsyncLogSink sink({.capacity = 4, .overflow = AsyncLogSink::Overflow::BLOCK});
+   for (int i = 0; i < 50; ++i)
+      Log::Debug("Tag", "{}", i);
+   sink.Flush();
+   ASSERT_EQ(50U, lines.size());
+   for (int i = 0; i < 50; ++i)
+      EXPECT_EQ(std::to_string(i), lines[i].text);
+   EXPECT_EQ(0U, sink.GetDroppedCount());
+}
+
+TEST_F(AsyncLogFixture, long_lines_are_truncated_not_overrun)
+{
+   const std::string longTag(100, 't');
+   const std::string longText(2 * Log::MAX_LINE_LENGTH, 'x');
+   AsyncLogSink sink({});
+   Log::Info(longTag.c_str(), longText.c_str());
+   sink.Flush();
+   ASSERT_EQ(1U, lines.size());
+   EXPECT_EQ(longTag.substr(0, AsyncLogSink::MAX_TAG_LENGTH), lines[0].tag);
+   EXPECT_EQ(longText.substr(0, Log::MAX_LINE_LENGTH), lines[0].text);
+}
+
+TEST(AsyncLogDeathTest, fatal_writes_out_earlier_lines_first)
+{
+   GTEST_FLAG_SET(death_test_style, "threadsafe");
+   EXPECT_DEATH(
+      {
+         AsyncLogSink sink({.flushInterval = std::chrono::hours(1)});
+         Log::Error("Test", "before");
+         Log::Fatal("Test", "boom");
+      },
+      "E/Test: before\n[-0-9: ]+ F/Test: boom\n$");
+}
+
+void SyncFileLog(FILE * file, const char * tag, const char * text)
+{
+   char timeBuf[64];
+   const std::time_t t = std::time(nullptr);
+   std::strftime(timeBuf, sizeof(timeBuf), "%F %T", std::gmtime(&t));
+   std::fprintf(file, "%s %c/%s: %s\n", timeBuf, 'I', tag, text);
+   std::fflush(file);
+}
+
+TEST(AsyncLogTest, benchmark_caller_cost_against_synchronous_logging)
+{
+   constexpr int LINES = 20'000;
+   static FILE * s_file = std::tmpfile();
+   ASSERT_NE(nullptr, s_file);
+
+   Log::s_infoHandler = [](const char * tag, const char * text) {
+      SyncFileLog(s_file, tag, text);
+   };
+   auto start = std::chrono::steady_clock::now();
+   for (int i = 0; i < LINES; ++i)
+      Log::Info("Bench", "line {} of {}", i, LINES);
+   const auto syncElapsed = std::chrono::steady_clock::now() - start;
+
+   std::chrono::steady_clock::duration asyncElapsed{};
+   {
+      AsyncLogSink sink({.capacity = 4096, .overflow = AsyncLogSink::Overflow::BLOCK});
+      start = std::chrono::steady_clock::now();
+      for (int i = 0; i < LINES; ++i)
+         Log::Info("Bench", "line {} of {}", i, LINES);
+      asyncElapsed = std::chrono::steady_clock::now() - start;
+   }
+   Log::s_infoHandler = nullptr;
+   std::fclose(s_file);
+
+   auto nsPerLine = [](std::chrono::steady_clock::duration d) {
+      const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+      return std::to_string(ns / LINES);
+   };
+   RecordProperty("sync_ns_per_line", nsPerLine(syncElapsed));
+   RecordProperty("async_ns_per_line", nsPerLine(asyncElapsed));
+   EXPECT_GT(std::chrono::seconds(5), syncElapsed + asyncElapsed);
+}
+
+} // namespace
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+#include "utils/histogram.hpp"
+
+namespace {
+
+TEST(HistogramTest, histogram_buckets_are_log_linear)
+{
+   using H = stats::Histogram<2, 10>;
+   static_assert(H::BUCKET_COUNT == 9 * 4);
+
+   for (uint64_t value = 0; value < 4; ++value)
+      EXPECT_EQ(value, H::BucketIndex(value));
+   EXPECT_EQ(4U, H::BucketIndex(4));
+   EXPECT_EQ(7U, H::BucketIndex(7));
+   EXPECT_EQ(8U, H::BucketIndex(8));
+   EXPECT_EQ(8U, H::BucketIndex(9));
+   EXPECT_EQ(11U, H::BucketIndex(15));
+   EXPECT_EQ(H::BUCKET_COUNT - 1, H::BucketIndex(1023));
+   EXPECT_EQ(H::BUCKET_COUNT - 1, H::BucketIndex(1U << 20));
+
+   for (size_t i = 0; i < H::BUCKET_COUNT; ++i) {
+      EXPECT_EQ(i, H::BucketIndex(H::LowerBound(i)));
+      if (i > 0) {
+         EXPECT_EQ(i - 1, H::BucketIndex(H::LowerBound(i) - 1));
+      }
+   }
+}
+
+TEST(HistogramTest, histogram_snapshot_reports_percentiles)
+{
+   stats::Histogram<> h;
+   EXPECT_EQ(0U, h.GetSnapshot().Percentile(50));
+
+   for (uint64_t value = 1; value <= 100; ++value)
+      h.Record(value);
+   h.Record(100'000);
+
+   const auto s = h.GetSnapshot();
+   EXPECT_EQ(101U, s.count);
+   EXPECT_EQ(100'000U, s.max);
+   EXPECT_EQ((5050U + 100'000U) / 101U, s.Mean());
+   EXPECT_EQ(1U, s.Percentile(0));
+   EXPECT_EQ(55U, s.Percentile(50)); // 51 lands in [48, 55]
+   EXPECT_EQ(111U, s.Percentile(99)); // 100 lands in [96, 111]
+   EXPECT_EQ(100'000U, s.Percentile(100));
+
+   h.Reset();
+   EXPECT_EQ(0U, h.GetSnapshot().count);
+}
+
+} // namespace
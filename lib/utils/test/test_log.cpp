@@ -208,23 +208,74 @@ TEST_F(LogFixture, logging_custom_formattable_type)
    EXPECT_STREQ("The dimensions are 1920x1080p", lines.back().text.c_str());
 }
 
+struct CountingFormattable
+{
+   int & writes;
+};
+
+std::span<char> WriteAsText(const CountingFormattable & arg, std::span<char> dest)
+{
+   ++arg.writes;
+   return fmt::Format(dest, "{}", arg.writes);
+}
+
+TEST_F(LogFixture, lines_below_runtime_level_are_not_formatted)
+{
+   int writes = 0;
+   Log::s_level = Log::Level::WARNING;
+   Log::Debug("tag", "debug {}", CountingFormattable{writes});
+   Log::Info("tag", "info {}", CountingFormattable{writes});
+   Log::Info("tag", "info");
+   Log::Warning("tag", "warning {}", CountingFormattable{writes});
+   Log::Error("tag", fmt::Runtime("error {}"), CountingFormattable{writes});
+   Log::s_level = Log::Level::DEBUG;
+
+   EXPECT_EQ(2, writes);
+   ASSERT_EQ(2U, lines.size());
+   EXPECT_EQ(Level::WARNING, lines[0].lvl);
+   EXPECT_STREQ("warning 1", lines[0].text.c_str());
+   EXPECT_EQ(Level::ERROR, lines[1].lvl);
+   EXPECT_STREQ("error 2", lines[1].text.c_str());
+}
+
+TEST(FormatTest, checked_format_string_matches_runtime_formatting)
+{
+   static constexpr fmt::FormatString<int, int, int> checked = "{{}, {}}{}";
+   static_assert(checked.Segments()[0] == "{");
+   static_assert(checked.Segments()[1] == ", ");
+   static_assert(checked.Segments()[2] == "}");
+   static_assert(checked.Segments()[3].empty());
+
+   std::array<char, 32> checkedBuffer{};
+   std::array<char, 32> runtimeBuffer{};
+   fmt::Format(checkedBuffer, "{{}, {}}{}", 1, "two", '3');
+   fmt::Format(runtimeBuffer, fmt::Runtime("{{}, {}}{}"), 1, "two", '3');
+   EXPECT_STREQ("{1, two}3", checkedBuffer.data());
+   EXPECT_STREQ(runtimeBuffer.data(), checkedBuffer.data());
+
+   std::array<char, 5> shortBuffer{};
+   auto rest = fmt::Format(std::span(shortBuffer).first(4), "{}-{}", "12", "345");
+   EXPECT_TRUE(rest.empty());
+   EXPECT_STREQ("12-3", shortBuffer.data());
+}
+
 TEST_F(LogFixture, logging_too_few_or_too_many_args)
 {
-   Log::Info("tag", "The superfluous {} will be at the end", "argument", 42);
+   Log::Info("tag", fmt::Runtime("The superfluous {} will be at the end"), "argument", 42);
    ASSERT_FALSE(lines.empty());
    EXPECT_EQ(Level::INFO, lines.back().lvl);
    EXPECT_STREQ("tag", lines.back().tag.c_str());
    EXPECT_STREQ("The superfluous argument will be at the end42", lines.back().text.c_str());
 
    lines.clear();
-   Log::Info("tag", "Too few {} will not {} an exception", "arguments");
+   Log::Info("tag", fmt::Runtime("Too few {} will not {} an exception"), "arguments");
    ASSERT_FALSE(lines.empty());
    EXPECT_EQ(Level::INFO, lines.back().lvl);
    EXPECT_STREQ("tag", lines.back().tag.c_str());
    EXPECT_STREQ("Too few arguments will not ", lines.back().text.c_str());
 
    lines.clear();
-   Log::Error("tag", "This {} never {} crash", std::string("will"));
+   Log::Error("tag", fmt::Runtime("This {} never {} crash"), std::string("will"));
    ASSERT_FALSE(lines.empty());
    EXPECT_EQ(Level::ERROR, lines.back().lvl);
    EXPECT_STREQ("tag", lines.back().tag.c_str());
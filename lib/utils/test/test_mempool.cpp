@@ -242,4 +242,47 @@ TEST(MempoolTest, poolptr_handles_inheritancy_and_virtual_functions)
    EXPECT_TRUE(childDtorCalled);
 }
 
-} // namespace
\ No newline at end of file
+TEST(MempoolTest, mempool_collects_stats_per_size_class)
+{
+   mem::Pool<4, 16> pool(2);
+   auto stats = pool.GetStats();
+   EXPECT_EQ(4U, stats[0].blockSize);
+   EXPECT_EQ(16U, stats[1].blockSize);
+   EXPECT_EQ(2U, stats[0].blockCount);
+   EXPECT_EQ(0U, stats[0].liveBlocks);
+   EXPECT_EQ(0U, stats[0].allocations);
+
+   auto p1 = pool.MakeUnique<int32_t>(1);
+   auto p2 = pool.MakeUnique<int32_t>(2);
+   auto p3 = pool.MakeUnique<int32_t>(3);
+   auto p4 = pool.MakeShared<std::pair<int64_t, int64_t>>(4, 4);
+
+   stats = pool.GetStats();
+   EXPECT_EQ(3U, stats[0].blockCount);
+   EXPECT_EQ(3U, stats[0].liveBlocks);
+   EXPECT_EQ(3U, stats[0].highWaterMark);
+   EXPECT_EQ(1U, stats[0].misses);
+   EXPECT_EQ(3U, stats[0].allocations);
+   EXPECT_EQ(1U + 1U + 2U, stats[0].probes);
+   EXPECT_EQ(1U, stats[1].liveBlocks);
+   EXPECT_EQ(0U, stats[1].misses);
+
+   p1.reset();
+   p2.reset();
+   p4.reset();
+   stats = pool.GetStats();
+   EXPECT_EQ(1U, stats[0].liveBlocks);
+   EXPECT_EQ(3U, stats[0].highWaterMark);
+   EXPECT_EQ(0U, stats[1].liveBlocks);
+   EXPECT_EQ(1U, stats[1].highWaterMark);
+
+   pool.ResetStats();
+   stats = pool.GetStats();
+   EXPECT_EQ(1U, stats[0].liveBlocks);
+   EXPECT_EQ(1U, stats[0].highWaterMark);
+   EXPECT_EQ(0U, stats[0].misses);
+   EXPECT_EQ(0U, stats[0].allocations);
+   EXPECT_EQ(0U, stats[1].highWaterMark);
+}
+
+} // namespace
@@ -2,8 +2,14 @@
 #include "utils/task.hpp"
 #include "utils/taskowner.hpp"
 #include "utils/taskutils.hpp"
+#include "utils/virtualscheduler.hpp"
 
+#include <chrono>
 #include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace {
 
@@ -164,6 +170,40 @@ TEST_F(TaskHandleFixture, task_is_canceled_when_handle_dies)
    EXPECT_EQ(0, state.count);
 }
 
+TEST_F(TaskHandleFixture, canceled_task_chain_is_destroyed_when_awaiter_withdraws)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+      bool withdrawn = false;
+      int count = 0;
+   } state;
+
+   struct WithdrawableAwaitable : Awaitable<State>
+   {
+      bool Withdraw() noexcept { return state.withdrawn = true; }
+   };
+
+   auto StartInnerVoidOperation = [](State & s) -> cr::TaskHandle<void> {
+      Counter c(s.count);
+      co_await WithdrawableAwaitable{{s}};
+   };
+
+   auto StartOuterVoidOperation = [=](State & s) -> cr::TaskHandle<void> {
+      Counter c(s.count);
+      co_await StartInnerVoidOperation(s);
+   };
+
+   auto task = StartOuterVoidOperation(state);
+   task.Run();
+   EXPECT_TRUE(state.handle);
+   EXPECT_EQ(2, state.count);
+
+   task = {};
+   EXPECT_TRUE(state.withdrawn);
+   EXPECT_EQ(0, state.count);
+}
+
 TEST_F(TaskHandleFixture, task_resumes_outer_task)
 {
    struct State
@@ -669,8 +709,6 @@ TEST_F(TaskHandleFixture, task_owner_starts_a_task)
    state.handle.resume();
    EXPECT_TRUE(state.beforeSuspend);
    EXPECT_TRUE(state.afterSuspend);
-   EXPECT_TRUE(state.handle);
-   EXPECT_TRUE(state.handle.done());
 }
 
 TEST_F(TaskHandleFixture, task_owner_cancels_tasks_when_dies)
@@ -704,6 +742,71 @@ TEST_F(TaskHandleFixture, task_owner_cancels_tasks_when_dies)
    EXPECT_TRUE(state.handle);
 }
 
+TEST_F(TaskHandleFixture, task_owner_destroys_tasks_as_soon_as_they_finish)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   };
+   std::vector<State> states(100);
+   int liveFrames = 0;
+
+   static auto VoidTask = [](State & s, int & frames) -> cr::TaskHandle<void> {
+      Counter c(frames);
+      co_await Awaitable<State>{s};
+   };
+
+   cr::TaskOwner<> owner;
+   for (auto & state : states)
+      owner.StartRootTask(VoidTask(state, liveFrames));
+   EXPECT_EQ(100, liveFrames);
+
+   for (size_t i = 0; i < states.size(); i += 2)
+      states[i].handle.resume();
+   EXPECT_EQ(50, liveFrames);
+
+   // freed slots are reused
+   for (size_t i = 0; i < states.size(); i += 2)
+      owner.StartRootTask(VoidTask(states[i], liveFrames));
+   EXPECT_EQ(100, liveFrames);
+   for (auto & state : states)
+      state.handle.resume();
+   EXPECT_EQ(0, liveFrames);
+}
+
+TEST_F(TaskHandleFixture, task_owner_keeps_exceptions_of_finished_tasks)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   } state1, state2;
+
+   static auto ThrowingTask = [](State & s, const char * what) -> cr::TaskHandle<void> {
+      co_await Awaitable<State>{s};
+      throw std::runtime_error(what);
+   };
+
+   cr::TaskOwner<> owner;
+   owner.StartRootTask(ThrowingTask(state1, "first"));
+   owner.StartRootTask(ThrowingTask(state2, "second"));
+   EXPECT_NO_THROW(owner.RethrowExceptions());
+
+   state2.handle.resume();
+   state1.handle.resume();
+   EXPECT_THROW(
+      {
+         try {
+            owner.RethrowExceptions();
+         } catch (const std::runtime_error & e) {
+            EXPECT_STREQ("second", e.what());
+            throw;
+         }
+      },
+      std::runtime_error);
+   EXPECT_THROW(owner.StartRootTask(ThrowingTask(state1, "third")), std::runtime_error);
+   EXPECT_NO_THROW(owner.RethrowExceptions());
+}
+
 TEST_F(TaskHandleFixture, task_owner_starts_a_nested_task)
 {
    struct State
@@ -941,4 +1044,390 @@ TEST_F(TaskHandleFixture, anyof_handles_immediate_task_and_short_circuits)
    EXPECT_FALSE(stringResult2.has_value());
 }
 
+TEST_F(TaskHandleFixture, anyof_destroys_withdrawable_losers_when_winner_finishes)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+      int withdrawn = 0;
+   } winnerState, loserState;
+
+   struct WithdrawableAwaitable : Awaitable<State>
+   {
+      bool Withdraw() noexcept
+      {
+         ++state.withdrawn;
+         return true;
+      }
+   };
+
+   int liveFrames = 0;
+   static auto Winner = [](State & s, int & frames) -> cr::TaskHandle<int> {
+      Counter c(frames);
+      co_await Awaitable<State>{s};
+      co_return 42;
+   };
+   static auto Loser = [](State & s, int & frames) -> cr::TaskHandle<std::string> {
+      Counter c(frames);
+      co_await WithdrawableAwaitable{{s}};
+      co_return "too late";
+   };
+
+   std::optional<size_t> index;
+   std::optional<int> framesAfterWin;
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      // keep the AnyOf task alive past the win, it must not hold on to the loser
+      auto race = cr::AnyOf(Winner(winnerState, liveFrames), Loser(loserState, liveFrames));
+      const auto result = co_await std::move(race);
+      index = result.index();
+      framesAfterWin = liveFrames;
+   };
+
+   OuterTask();
+   EXPECT_EQ(2, liveFrames);
+
+   winnerState.handle.resume();
+   EXPECT_EQ(0U, index);
+   EXPECT_EQ(0, framesAfterWin);
+   EXPECT_EQ(1, loserState.withdrawn);
+   EXPECT_EQ(0, liveFrames);
+}
+
+TEST_F(TaskHandleFixture, anyof_unwinds_non_withdrawable_losers_on_next_resumption)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   } winnerState, loserState;
+
+   int liveFrames = 0;
+   bool loserFinished = false;
+   static auto Winner = [](State & s, int & frames) -> cr::TaskHandle<void> {
+      Counter c(frames);
+      co_await Awaitable<State>{s};
+   };
+   static auto Loser = [](State & s, int & frames, bool & finished) -> cr::TaskHandle<void> {
+      Counter c(frames);
+      co_await Awaitable<State>{s};
+      finished = true;
+   };
+
+   std::optional<int> framesAfterWin;
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      auto race =
+         cr::AnyOf(Winner(winnerState, liveFrames), Loser(loserState, liveFrames, loserFinished));
+      co_await std::move(race);
+      framesAfterWin = liveFrames;
+   };
+
+   OuterTask();
+   winnerState.handle.resume();
+   // canceled, but only its current awaiter can resume it
+   EXPECT_EQ(1, framesAfterWin);
+
+   loserState.handle.resume();
+   EXPECT_FALSE(loserFinished);
+   EXPECT_EQ(0, liveFrames);
+}
+
+struct WithdrawableSleep
+{
+   cr::VirtualScheduler & scheduler;
+   std::chrono::milliseconds delay;
+   cr::VirtualScheduler::TimerId id = cr::VirtualScheduler::NO_TIMER;
+
+   bool await_ready() const noexcept { return false; }
+   void await_suspend(stdcr::coroutine_handle<> h) { id = scheduler.Schedule(h, delay); }
+   void await_resume() const noexcept {}
+   bool Withdraw() noexcept { return scheduler.Cancel(id); }
+};
+
+TEST(AnyOfTest, losing_timeout_releases_its_timer_at_once)
+{
+   using namespace std::chrono_literals;
+   using Task = cr::TaskHandle<void, cr::VirtualScheduler::Executor>;
+   cr::VirtualScheduler scheduler;
+
+   static auto Sleep = [](cr::VirtualScheduler & s, std::chrono::milliseconds delay) -> Task {
+      co_await WithdrawableSleep{s, delay};
+   };
+
+   std::optional<size_t> index;
+   auto race = [&](cr::VirtualScheduler & s) -> Task {
+      const auto result = co_await cr::AnyOf(Sleep(s, 5ms), Sleep(s, 10s));
+      index = result.index();
+   };
+
+   auto task = race(scheduler);
+   task.Run(scheduler.GetExecutor());
+   scheduler.RunFor(5ms);
+   EXPECT_EQ(0U, index);
+   EXPECT_EQ(0U, scheduler.PendingCount());
+   EXPECT_EQ(5ms, scheduler.Now());
+}
+
+TEST_F(TaskHandleFixture, whenall_waits_for_every_task_and_keeps_their_order)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   };
+   std::vector<State> states(3);
+
+   static auto IntegerTask = [](State * s, int value) -> cr::TaskHandle<int> {
+      if (s)
+         co_await Awaitable<State>{*s};
+      co_return value;
+   };
+
+   std::optional<std::vector<int>> results;
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      std::vector<cr::TaskHandle<int>> tasks;
+      tasks.push_back(IntegerTask(&states[0], 1));
+      tasks.push_back(IntegerTask(nullptr, 2));
+      tasks.push_back(IntegerTask(&states[2], 3));
+      results = co_await cr::WhenAll(std::move(tasks));
+   };
+
+   OuterTask();
+   EXPECT_TRUE(states[0].handle);
+   EXPECT_TRUE(states[2].handle);
+   EXPECT_FALSE(results.has_value());
+
+   states[2].handle.resume();
+   EXPECT_FALSE(results.has_value());
+
+   states[0].handle.resume();
+   ASSERT_TRUE(results.has_value());
+   EXPECT_EQ((std::vector<int>{1, 2, 3}), *results);
+}
+
+TEST_F(TaskHandleFixture, whenall_handles_void_and_empty_ranges)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   } state1, state2;
+
+   static auto VoidTask = [](State & s) -> cr::TaskHandle<void> {
+      co_await Awaitable<State>{s};
+   };
+
+   size_t finished = 0;
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      co_await cr::WhenAll(std::vector<cr::TaskHandle<void>>{});
+      ++finished;
+      std::vector<cr::TaskHandle<void>> tasks;
+      tasks.push_back(VoidTask(state1));
+      tasks.push_back(VoidTask(state2));
+      co_await cr::WhenAll(std::move(tasks));
+      ++finished;
+   };
+
+   OuterTask();
+   EXPECT_EQ(1U, finished);
+   state1.handle.resume();
+   EXPECT_EQ(1U, finished);
+   state2.handle.resume();
+   EXPECT_EQ(2U, finished);
+}
+
+TEST_F(TaskHandleFixture, whenall_rethrows_after_all_tasks_are_done)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   } state1, state2;
+
+   static auto ThrowingTask = [](State & s) -> cr::TaskHandle<void> {
+      co_await Awaitable<State>{s};
+      throw std::runtime_error("oops");
+   };
+   static auto VoidTask = [](State & s) -> cr::TaskHandle<void> {
+      co_await Awaitable<State>{s};
+   };
+
+   std::optional<std::string> error;
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      std::vector<cr::TaskHandle<void>> tasks;
+      tasks.push_back(ThrowingTask(state1));
+      tasks.push_back(VoidTask(state2));
+      try {
+         co_await cr::WhenAll(std::move(tasks));
+      } catch (const std::exception & e) {
+         error.emplace(e.what());
+      }
+   };
+
+   OuterTask();
+   state1.handle.resume();
+   EXPECT_FALSE(error.has_value());
+   state2.handle.resume();
+   EXPECT_EQ("oops", error);
+}
+
+TEST_F(TaskHandleFixture, whenany_delivers_first_result_and_cancels_others)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+      bool finished = false;
+   };
+   std::vector<State> states(3);
+
+   static auto IntegerTask = [](State & s, int value) -> cr::TaskHandle<int> {
+      co_await Awaitable<State>{s};
+      s.finished = true;
+      co_return value;
+   };
+
+   std::optional<std::pair<size_t, int>> result;
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      std::vector<cr::TaskHandle<int>> tasks;
+      for (size_t i = 0; i < states.size(); ++i)
+         tasks.push_back(IntegerTask(states[i], static_cast<int>(i) * 10));
+      result = co_await cr::WhenAny(std::move(tasks));
+   };
+
+   OuterTask();
+   EXPECT_FALSE(result.has_value());
+
+   states[1].handle.resume();
+   ASSERT_TRUE(result.has_value());
+   EXPECT_EQ(1U, result->first);
+   EXPECT_EQ(10, result->second);
+
+   // the losers were canceled, resuming them must neither finish them nor touch the result
+   result.reset();
+   states[0].handle.resume();
+   states[2].handle.resume();
+   EXPECT_FALSE(states[0].finished);
+   EXPECT_FALSE(states[2].finished);
+   EXPECT_FALSE(result.has_value());
+}
+
+TEST_F(TaskHandleFixture, whenany_short_circuits_on_immediate_task)
+{
+   struct State
+   {
+      stdcr::coroutine_handle<> handle = nullptr;
+   } state;
+
+   static auto VoidTask = [](State * s) -> cr::TaskHandle<void> {
+      if (s)
+         co_await Awaitable<State>{*s};
+   };
+
+   std::optional<size_t> index;
+   auto OuterTask = [&]() -> cr::DetachedHandle {
+      std::vector<cr::TaskHandle<void>> tasks;
+      tasks.push_back(VoidTask(&state));
+      tasks.push_back(VoidTask(nullptr));
+      index = co_await cr::WhenAny(std::move(tasks));
+   };
+
+   OuterTask();
+   EXPECT_TRUE(state.handle);
+   EXPECT_EQ(1U, index);
+}
+
+TEST_F(TaskHandleFixture, deep_task_chains_run_in_constant_stack_space)
+{
+   // each level would take at least a few stack frames if tasks were resumed by nested calls
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__OPTIMIZE__)
+   constexpr size_t DEPTH = 1'000; // see cr::internal::Transfer(), only checks the result here
+#else
+   constexpr size_t DEPTH = 1'000'000;
+#endif
+   struct State
+   {
+      stdcr::coroutine_handle<> handle;
+   } state;
+
+   struct Chain
+   {
+      static cr::TaskHandle<size_t> Run(size_t depth, State & state)
+      {
+         if (depth == 0) {
+            co_await Awaitable<State>{state};
+            co_return 0;
+         }
+         co_return 1 + co_await Run(depth - 1, state);
+      }
+   };
+
+   auto task = Chain::Run(DEPTH, state);
+   std::optional<size_t> result;
+   auto Outer = [&]() -> cr::DetachedHandle {
+      result = co_await std::move(task);
+   };
+   Outer();
+   ASSERT_TRUE(state.handle);
+   EXPECT_FALSE(result);
+
+   state.handle.resume();
+   EXPECT_EQ(DEPTH, result);
+}
+
+struct VirtualSleep
+{
+   cr::VirtualScheduler & scheduler;
+   std::chrono::milliseconds delay;
+
+   bool await_ready() const noexcept { return false; }
+   void await_suspend(stdcr::coroutine_handle<> h) { scheduler.Schedule(h, delay); }
+   void await_resume() const noexcept {}
+};
+
+TEST(FramePoolTest, simulated_rolls_reuse_pooled_frames)
+{
+   // mimics the coroutines of a roll: the FSM step issues a command that waits for its
+   // response with a timeout, and a detached handler sends the result to the peers
+   using Task = cr::TaskHandle<int, cr::VirtualScheduler::Executor>;
+   constexpr size_t WARMUP_ROLLS = 10;
+   constexpr size_t ROLLS = 1000;
+
+   cr::VirtualScheduler scheduler;
+   auto waitFor = [](cr::VirtualScheduler & s, std::chrono::milliseconds delay) -> Task {
+      co_await VirtualSleep{s, delay};
+      co_return 0;
+   };
+   auto command = [=](cr::VirtualScheduler & s) -> Task {
+      co_await VirtualSleep{s, std::chrono::milliseconds(5)}; // response
+      co_return co_await waitFor(s, std::chrono::milliseconds(1));
+   };
+   auto send = [](cr::VirtualScheduler & s, int & sent) -> cr::DetachedHandle {
+      co_await VirtualSleep{s, std::chrono::milliseconds(2)};
+      ++sent;
+   };
+   int sent = 0;
+   auto roll = [&](cr::VirtualScheduler & s) -> Task {
+      co_await command(s);
+      send(s, sent);
+      co_return 0;
+   };
+
+   auto runRolls = [&](size_t count) {
+      for (size_t i = 0; i < count; ++i) {
+         auto task = roll(scheduler);
+         task.Run(scheduler.GetExecutor());
+         scheduler.RunUntilIdle();
+      }
+   };
+   runRolls(WARMUP_ROLLS);
+   const auto before = mem::FramePool::GetStats();
+   runRolls(ROLLS);
+   const auto after = mem::FramePool::GetStats();
+
+   EXPECT_EQ(int(WARMUP_ROLLS + ROLLS), sent);
+   const size_t frames = after.allocations - before.allocations;
+   const size_t heapFrames = after.heapAllocations - before.heapAllocations;
+   RecordProperty("frames_per_roll", std::to_string(frames / ROLLS));
+   RecordProperty("heap_frames_per_roll", std::to_string(heapFrames / ROLLS));
+#if CR_POOLED_FRAMES
+   EXPECT_EQ(4U * ROLLS, frames);
+   EXPECT_EQ(0U, heapFrames);
+#endif
+}
+
 } // namespace
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include "utils/task.hpp"
+#include "utils/uniquefunction.hpp"
+
+#include <array>
+#include <memory>
+#include <string>
+
+namespace {
+
+struct Tracker
+{
+   int & alive;
+
+   explicit Tracker(int & alive)
+      : alive(alive)
+   {
+      ++alive;
+   }
+   Tracker(Tracker && other) noexcept
+      : alive(other.alive)
+   {
+      ++alive;
+   }
+   ~Tracker() { --alive; }
+};
+
+TEST(UniqueFunctionTest, holds_move_only_callables)
+{
+   auto value = std::make_unique<int>(42);
+   UniqueFunction<int(int)> f = [v = std::move(value)](int add) {
+      return *v + add;
+   };
+   EXPECT_TRUE(f);
+   EXPECT_EQ(43, f(1));
+
+   UniqueFunction<int(int)> g = std::move(f);
+   EXPECT_FALSE(f);
+   EXPECT_EQ(44, g(2));
+
+   g = nullptr;
+   EXPECT_FALSE(g);
+}
+
+TEST(UniqueFunctionTest, destroys_inline_and_heap_callables_exactly_once)
+{
+   int alive = 0;
+   {
+      UniqueFunction<void()> small = [t = Tracker(alive)] {};
+      std::array<char, UniqueFunction<void()>::INLINE_SIZE> padding{};
+      UniqueFunction<void()> big = [t = Tracker(alive), padding] {};
+      static_assert(UniqueFunction<void()>::IS_INLINE<decltype([t = Tracker(alive)] {})>);
+      static_assert(!UniqueFunction<void()>::IS_INLINE<decltype([t = Tracker(alive), padding] {})>);
+      EXPECT_EQ(2, alive);
+
+      UniqueFunction<void()> moved = std::move(small);
+      UniqueFunction<void()> movedBig = std::move(big);
+      EXPECT_EQ(2, alive);
+
+      moved = std::move(movedBig);
+      EXPECT_EQ(1, alive);
+   }
+   EXPECT_EQ(0, alive);
+}
+
+TEST(UniqueFunctionTest, forwards_arguments_and_results)
+{
+   UniqueFunction<std::string(std::string &&, const std::string &)> concat =
+      [](std::string && a, const std::string & b) {
+         return std::move(a) + b;
+      };
+   const std::string b = "def";
+   EXPECT_EQ("abcdef", concat("abc", b));
+}
+
+TEST(UniqueFunctionTest, resumes_coroutine_handles)
+{
+   stdcr::coroutine_handle<> handle;
+   bool resumed = false;
+
+   struct Awaitable
+   {
+      stdcr::coroutine_handle<> & handle;
+      bool await_ready() { return false; }
+      void await_suspend(stdcr::coroutine_handle<> h) { handle = h; }
+      void await_resume() {}
+   };
+   auto StartOperation = [&]() -> cr::DetachedHandle {
+      co_await Awaitable{handle};
+      resumed = true;
+   };
+   StartOperation();
+   ASSERT_TRUE(handle);
+
+   UniqueFunction<void()> task = handle;
+   UniqueFunction<void()> moved = std::move(task);
+   EXPECT_FALSE(resumed);
+   moved();
+   EXPECT_TRUE(resumed);
+}
+
+} // namespace
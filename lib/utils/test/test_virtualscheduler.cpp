@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include "utils/task.hpp"
+#include "utils/virtualscheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+using namespace std::chrono_literals;
+using cr::VirtualScheduler;
+
+TEST(VirtualSchedulerTest, runs_tasks_in_deadline_then_scheduling_order)
+{
+   VirtualScheduler scheduler;
+   std::string order;
+   scheduler.Schedule(
+      [&] {
+         order += 'c';
+      },
+      2s);
+   scheduler.Schedule(
+      [&] {
+         order += 'a';
+      },
+      1s);
+   scheduler.Schedule(
+      [&] {
+         order += 'b';
+      },
+      1s);
+   scheduler.Schedule(
+      [&] {
+         order += 'd';
+      },
+      2s);
+
+   EXPECT_EQ(4U, scheduler.RunUntilIdle());
+   EXPECT_EQ("abcd", order);
+   EXPECT_EQ(2s, scheduler.Now());
+}
+
+TEST(VirtualSchedulerTest, clock_moves_only_as_far_as_asked)
+{
+   VirtualScheduler scheduler;
+   std::vector<std::chrono::milliseconds> firedAt;
+   scheduler.Schedule(
+      [&] {
+         firedAt.push_back(scheduler.Now());
+      },
+      10s);
+   scheduler.Schedule(
+      [&] {
+         firedAt.push_back(scheduler.Now());
+      },
+      0ms);
+
+   EXPECT_EQ(1U, scheduler.RunReady());
+   EXPECT_EQ(0ms, scheduler.Now());
+
+   EXPECT_EQ(0U, scheduler.RunFor(9s));
+   EXPECT_EQ(9s, scheduler.Now());
+
+   EXPECT_EQ(1U, scheduler.RunFor(5s));
+   EXPECT_EQ(14s, scheduler.Now());
+   EXPECT_EQ((std::vector<std::chrono::milliseconds>{0ms, 10s}), firedAt);
+}
+
+TEST(VirtualSchedulerTest, tasks_scheduled_while_running_use_the_virtual_time)
+{
+   VirtualScheduler scheduler;
+   std::vector<std::chrono::milliseconds> firedAt;
+   scheduler.Schedule(
+      [&] {
+         scheduler.Schedule(
+            [&] {
+               firedAt.push_back(scheduler.Now());
+            },
+            500ms);
+         scheduler.Schedule(
+            [&] {
+               firedAt.push_back(scheduler.Now());
+            },
+            -1s);
+      },
+      1s);
+
+   EXPECT_EQ(3U, scheduler.RunFor(2s));
+   EXPECT_EQ((std::vector<std::chrono::milliseconds>{1s, 1500ms}), firedAt);
+}
+
+TEST(VirtualSchedulerTest, cancelled_tasks_never_run)
+{
+   VirtualScheduler scheduler;
+   bool fired = false;
+   const auto id = scheduler.Schedule(
+      [&] {
+         fired = true;
+      },
+      1s);
+   const auto other = scheduler.Schedule([] {}, 1s);
+
+   EXPECT_TRUE(scheduler.Cancel(id));
+   EXPECT_FALSE(scheduler.Cancel(id));
+   EXPECT_EQ(1U, scheduler.PendingCount());
+   EXPECT_EQ(1U, scheduler.RunUntilIdle());
+   EXPECT_FALSE(fired);
+   EXPECT_FALSE(scheduler.Cancel(other));
+}
+
+struct Sleep
+{
+   VirtualScheduler & scheduler;
+   std::chrono::milliseconds delay;
+
+   bool await_ready() const noexcept { return false; }
+   void await_suspend(stdcr::coroutine_handle<> h) { scheduler.Schedule(h, delay); }
+   void await_resume() const noexcept {}
+};
+
+TEST(VirtualSchedulerTest, runs_long_coroutine_sessions_in_virtual_time)
+{
+   using Task = cr::TaskHandle<void, VirtualScheduler::Executor>;
+   constexpr size_t SESSIONS = 1000;
+   constexpr size_t ROUNDS = 100;
+
+   VirtualScheduler scheduler;
+   size_t finished = 0;
+   std::chrono::milliseconds lastFinish{0};
+
+   auto session = [](VirtualScheduler & scheduler,
+                     size_t seed,
+                     size_t & finished,
+                     std::chrono::milliseconds & lastFinish) -> Task {
+      uint32_t state = static_cast<uint32_t>(seed) * 2654435761U + 1U;
+      for (size_t i = 0; i < ROUNDS; ++i) {
+         state = state * 1664525U + 1013904223U;
+         co_await Sleep{scheduler, std::chrono::milliseconds(state % 60'000U)};
+      }
+      ++finished;
+      lastFinish = std::max(lastFinish, scheduler.Now());
+   };
+
+   std::vector<Task> sessions;
+   for (size_t i = 0; i < SESSIONS; ++i) {
+      sessions.push_back(session(scheduler, i, finished, lastFinish));
+      sessions.back().Run(scheduler.GetExecutor());
+   }
+   const auto start = std::chrono::steady_clock::now();
+   scheduler.RunUntilIdle();
+   const auto elapsed = std::chrono::steady_clock::now() - start;
+
+   EXPECT_EQ(SESSIONS, finished);
+   EXPECT_EQ(lastFinish, scheduler.Now());
+   EXPECT_LT(30min, scheduler.Now());
+   EXPECT_GT(5s, elapsed);
+   const auto realMs = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+   RecordProperty("virtual_ms_per_real_ms", std::to_string(scheduler.Now().count() / (realMs + 1)));
+}
+
+} // namespace